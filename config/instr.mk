@@ -0,0 +1,3 @@
+include $(config_dir)rel.mk
+
+this_cxxflags += -DCSSOM_INSTRUMENTATION
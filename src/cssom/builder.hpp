@@ -0,0 +1,156 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "om.hpp"
+#include "parser.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Incremental style sheet builder.
+ * The CSS data is fed to the builder in chunks with parser::feed(), the parsed rules are published to the sheet
+ * as they are completed, so the sheet can be queried before the whole CSS data has arrived.
+ * The sheet only contains complete rules, i.e. the ones whose closing curly brace has been fed,
+ * and is always sorted by specificity, so queries on it give same results as on a sheet read from
+ * the CSS data fed so far, without the incomplete trailing rule.
+ */
+class sheet_builder : public parser
+{
+	sheet doc;
+
+	// Parsed styles not yet published to the sheet, in the source order.
+	// The styles refer to the property lists of the doc.
+	struct pending_style {
+		style s;
+
+		// index of the media block of the style, if any
+		std::optional<size_t> media_block;
+	};
+
+	std::vector<pending_style> pending;
+
+	// number of pending styles whose property blocks are complete
+	size_t num_complete = 0;
+
+	selector cur_selector;
+	selector_chain cur_selector_chain;
+	// index of the property list in the sheet's pool
+	std::optional<size_t> cur_property_list;
+	std::string cur_property_name;
+	// index of the current media block
+	std::optional<size_t> cur_media_block;
+
+	std::function<uint32_t(std::string_view)> property_name_to_id;
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property;
+
+	std::vector<parse_error> errors;
+
+	void on_selector_chain_end() override;
+	void on_selector_end() override;
+	void on_selector_tag(std::string str) override;
+	void on_selector_id(std::string str) override;
+	void on_selector_class(std::string str) override;
+	void on_selector_attribute(std::string name, std::string operation, std::string value) override;
+	void on_selector_pseudo_class(std::string name, std::string argument) override;
+	void on_combinator(std::string str) override;
+	void on_style_properties_end() override;
+	void on_property_name(std::string str) override;
+	void on_property_value(std::string str) override;
+	void on_media_begin(std::string condition) override;
+	void on_media_end() override;
+	void on_error(const parse_error& error) override;
+
+	void publish();
+
+public:
+	/**
+	 * @brief Create sheet builder.
+	 * @param property_name_to_id - function returning property id by its name.
+	 * @param parse_property_value - function parsing property value.
+	 * @throw std::logic_error if any of the functions is nullptr.
+	 */
+	sheet_builder(
+		std::function<uint32_t(std::string_view)> property_name_to_id,
+		std::function<property_value_holder(uint32_t, std::string_view)> parse_property_value
+	);
+
+	/**
+	 * @brief Check if all the data fed so far forms complete rules.
+	 * @return true if there is no partially fed rule or @media block.
+	 * @return false if more data is needed to complete a rule or @media block.
+	 */
+	bool is_complete() const noexcept
+	{
+		return this->is_idle() && !this->cur_property_list.has_value();
+	}
+
+	/**
+	 * @brief Get errors encountered so far in error recovery mode.
+	 * See parser::set_error_recovery().
+	 * @return the errors in the order of their appearance in the CSS data.
+	 */
+	const std::vector<parse_error>& get_errors() const& noexcept
+	{
+		return this->errors;
+	}
+
+	/**
+	 * @brief Move out the errors encountered in error recovery mode.
+	 * @return the errors in the order of their appearance in the CSS data.
+	 */
+	std::vector<parse_error> get_errors() && noexcept
+	{
+		return std::move(this->errors);
+	}
+
+	/**
+	 * @brief Get the sheet of the rules completed so far.
+	 * Publishes the rules completed since the previous call.
+	 * Publishing costs linear time of the sheet size, so it is better not to call this after each tiny chunk.
+	 * The returned reference stays valid for the lifetime of the builder,
+	 * but the sheet is modified by the following calls to get_sheet().
+	 * @return the sheet.
+	 */
+	const sheet& get_sheet();
+
+	/**
+	 * @brief Finish building.
+	 * Publishes the rules parsed so far and moves the sheet out of the builder.
+	 * Since end of data closes all open blocks in CSS, an incomplete trailing rule, if any,
+	 * is published as well, with the declarations parsed so far. Use is_complete() to check for that.
+	 * @return the built sheet.
+	 */
+	sheet build();
+};
+
+} // namespace cssom
@@ -0,0 +1,107 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "cascade.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+#include "instrumentation.hpp"
+
+using namespace cssom;
+
+void cascade::push_back(sheet s)
+{
+	this->sheets.push_back(std::move(s));
+}
+
+sheet::query_result cascade::get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const
+{
+	CSSOM_INSTRUMENTATION_COUNT(queries);
+
+	// Number of sheets in a cascade is normally small, so instead of maintaining a heap
+	// just select the next style by linear search through the current positions in each sheet.
+	std::vector<std::vector<style>::const_iterator> positions;
+	positions.reserve(this->sheets.size());
+	for (const auto& s : this->sheets) {
+		positions.push_back(s.styles.begin());
+	}
+
+	while (true) {
+		const style* next = nullptr;
+		const sheet* next_sheet = nullptr;
+		std::vector<style>::const_iterator* next_pos = nullptr;
+
+		// go from last sheet to first one, so that later sheets take precedence on equal specificity
+		for (size_t i = this->sheets.size(); i != 0;) {
+			--i;
+			auto& pos = positions[i];
+			if (pos == this->sheets[i].styles.end()) {
+				continue;
+			}
+			if (!next || pos->specificity > next->specificity) {
+				next = &*pos;
+				next_sheet = &this->sheets[i];
+				next_pos = &pos;
+			}
+		}
+
+		if (!next) {
+			break;
+		}
+
+		ASSERT(next_pos)
+		ASSERT(next_sheet)
+		++(*next_pos);
+
+		CSSOM_INSTRUMENTATION_COUNT(rules_examined);
+		CSSOM_INSTRUMENTATION_COUNT(crawler_reset_calls);
+		crawler.reset();
+
+		if (next->is_matching(crawler)) {
+			CSSOM_INSTRUMENTATION_COUNT(matches);
+			const auto& props = next_sheet->get_properties(*next);
+			auto i = props.find(property_id);
+			if (i != props.end()) {
+				// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+				return sheet::query_result{i->second.get(), next->specificity};
+			}
+		}
+	}
+
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	return sheet::query_result{nullptr, 0};
+}
+
+sheet cascade::flatten() const
+{
+	sheet ret;
+	for (const auto& s : this->sheets) {
+		ret.append(s);
+	}
+	return ret;
+}
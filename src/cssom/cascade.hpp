@@ -0,0 +1,73 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Cascade of style sheets.
+ * Holds several style sheets, each of which is sorted by specificity, without merging them into a single sheet.
+ * Sheets which go later in the cascade take precedence over styles of equal specificity from preceding sheets.
+ * For example, a base theme, a product theme and per-tenant overrides can be layered in that order,
+ * so that reloading one of the layers does not require re-sorting all the styles.
+ */
+struct cascade {
+	/**
+	 * @brief Sheets of the cascade.
+	 * Each sheet must be sorted by specificity, which is the case for sheets returned by cssom::read().
+	 */
+	std::vector<sheet> sheets{};
+
+	/**
+	 * @brief Add sheet to the end of the cascade.
+	 * The added sheet takes precedence over styles of equal specificity of all the other sheets of the cascade.
+	 * @param s - sheet to add. Must be sorted by specificity.
+	 */
+	void push_back(sheet s);
+
+	/**
+	 * @brief Get property value for given xml document node.
+	 * The styles of all sheets are examined in the order of descending specificity,
+	 * by merging the already sorted sheets on the fly.
+	 * @return pointer to the property value if given node has matched to some CSS selector which defines requested
+	 * property.
+	 * @return nullptr if given node has not matched to any CSS selector or no matching selectors define requested
+	 * property.
+	 */
+	sheet::query_result get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const;
+
+	/**
+	 * @brief Merge all sheets of the cascade into a single sheet.
+	 * The merge takes linear time, the resulting sheet gives same query results as the cascade.
+	 * @return merged sheet.
+	 */
+	sheet flatten() const;
+};
+
+} // namespace cssom
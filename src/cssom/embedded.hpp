@@ -0,0 +1,596 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+
+#include <utki/debug.hpp>
+#include <utki/util.hpp>
+
+#include "om.hpp"
+
+namespace cssom {
+
+namespace embedded {
+
+/**
+ * @brief Range of indices [begin, end) in one of the tables.
+ */
+struct range {
+	uint32_t begin = 0;
+	uint32_t end = 0;
+};
+
+struct selector_entry {
+	/**
+	 * @brief Tag name, "*" for the universal selector, empty if not specified.
+	 */
+	std::string_view tag;
+
+	/**
+	 * @brief Id, empty if not specified.
+	 */
+	std::string_view id;
+
+	/**
+	 * @brief Classes of the selector in the tables::classes.
+	 */
+	range classes;
+
+	/**
+	 * @brief Combinator to the next selector of the chain, same as cssom::selector::combinator.
+	 */
+	cssom::combinator combinator = cssom::combinator::none;
+};
+
+struct style_entry {
+	/**
+	 * @brief Selector chain of the style in the tables::selectors.
+	 */
+	range selectors;
+
+	/**
+	 * @brief Index of the style's property list in the tables::property_lists.
+	 */
+	uint32_t properties_index = 0;
+
+	uint32_t specificity = 0;
+};
+
+struct declaration_entry {
+	uint32_t property_id = 0;
+
+	/**
+	 * @brief Property value text, as it appears in the CSS source, with leading and trailing whitespace trimmed.
+	 */
+	std::string_view value;
+};
+
+/**
+ * @brief Sizes of the tables of a CSS source.
+ */
+struct sizes {
+	size_t num_styles = 0;
+	size_t num_selectors = 0;
+	size_t num_classes = 0;
+	size_t num_declarations = 0;
+	size_t num_property_lists = 0;
+};
+
+/**
+ * @brief Read-only tables of a parsed CSS source.
+ * All strings are views of the CSS source.
+ */
+template <
+	size_t num_styles,
+	size_t num_selectors,
+	size_t num_classes,
+	size_t num_declarations,
+	size_t num_property_lists>
+struct tables {
+	/**
+	 * @brief Styles, sorted same way as sheet::styles.
+	 */
+	std::array<style_entry, num_styles> styles{};
+
+	std::array<selector_entry, num_selectors> selectors{};
+	std::array<std::string_view, num_classes> classes{};
+	std::array<declaration_entry, num_declarations> declarations{};
+
+	/**
+	 * @brief Declarations of the property lists in the declarations table.
+	 */
+	std::array<range, num_property_lists> property_lists{};
+};
+
+namespace detail {
+
+constexpr bool is_space(char c) noexcept
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+constexpr bool is_name_char(char c) noexcept
+{
+	switch (c) {
+		case '.':
+		case '#':
+		case '*':
+		case '[':
+		case ']':
+		case ':':
+		case ';':
+		case '{':
+		case '}':
+		case '(':
+		case ')':
+		case ',':
+		case '>':
+		case '+':
+		case '~':
+		case '@':
+			return false;
+		default:
+			return !is_space(c);
+	}
+}
+
+constexpr std::string_view trim(std::string_view str) noexcept
+{
+	while (!str.empty() && is_space(str.front())) {
+		str.remove_prefix(1);
+	}
+	while (!str.empty() && is_space(str.back())) {
+		str.remove_suffix(1);
+	}
+	return str;
+}
+
+// Parses the subset of CSS supported by embedded sheets and reports the parsed parts to the handler.
+// Throwing makes the constant evaluation fail, so malformed CSS results in a compilation error.
+template <typename handler_type>
+constexpr void parse(std::string_view css, handler_type& h)
+{
+	size_t i = 0;
+
+	auto skip_spaces = [&css, &i]() {
+		while (i != css.size() && is_space(css[i])) {
+			++i;
+		}
+	};
+
+	auto read_name = [&css, &i]() {
+		auto begin = i;
+		while (i != css.size() && is_name_char(css[i])) {
+			++i;
+		}
+		if (i == begin) {
+			throw std::logic_error("embedded CSS: name expected");
+		}
+		return css.substr(begin, i - begin);
+	};
+
+	skip_spaces();
+
+	while (i != css.size()) {
+		// selector group
+		while (true) {
+			std::string_view tag;
+			std::string_view id;
+			bool has_classes = false;
+
+			if (css[i] == '*') {
+				tag = css.substr(i, 1);
+				++i;
+			} else if (is_name_char(css[i])) {
+				tag = read_name();
+			}
+
+			while (i != css.size()) {
+				if (css[i] == '.') {
+					++i;
+					h.on_class(read_name());
+					has_classes = true;
+				} else if (css[i] == '#') {
+					++i;
+					if (!id.empty()) {
+						throw std::logic_error("embedded CSS: more than one id in a selector");
+					}
+					id = read_name();
+				} else {
+					break;
+				}
+			}
+
+			if (tag.empty() && id.empty() && !has_classes) {
+				throw std::logic_error("embedded CSS: selector expected, attribute selectors, pseudo-classes and at-rules are not supported");
+			}
+
+			h.on_selector(tag, id);
+
+			bool space_after = i != css.size() && is_space(css[i]);
+			skip_spaces();
+
+			if (i == css.size()) {
+				throw std::logic_error("embedded CSS: unexpected end of data");
+			}
+
+			auto c = css[i];
+			if (c == '>' || c == '+' || c == '~') {
+				h.on_combinator(
+					c == '>' ? cssom::combinator::child
+							 : (c == '+' ? cssom::combinator::next_sibling : cssom::combinator::subsequent_sibling)
+				);
+				++i;
+				skip_spaces();
+			} else if (c == ',') {
+				h.on_selector_chain_end();
+				++i;
+				skip_spaces();
+			} else if (c == '{') {
+				h.on_selector_chain_end();
+				++i;
+				break;
+			} else if (space_after) {
+				h.on_combinator(cssom::combinator::descendant);
+			} else {
+				throw std::logic_error("embedded CSS: unexpected character in selector");
+			}
+
+			if (i == css.size()) {
+				throw std::logic_error("embedded CSS: unexpected end of data");
+			}
+		}
+
+		// declarations
+		while (true) {
+			skip_spaces();
+
+			if (i == css.size()) {
+				throw std::logic_error("embedded CSS: unexpected end of data");
+			}
+
+			if (css[i] == '}') {
+				++i;
+				break;
+			}
+
+			auto name_begin = i;
+			while (i != css.size() && css[i] != ':') {
+				if (css[i] == ';' || css[i] == '}') {
+					throw std::logic_error("embedded CSS: colon expected after property name");
+				}
+				++i;
+			}
+			if (i == css.size()) {
+				throw std::logic_error("embedded CSS: unexpected end of data");
+			}
+			auto name = trim(css.substr(name_begin, i - name_begin));
+			++i;
+
+			auto value_end = css.find_first_of(";}", i);
+			if (value_end == std::string_view::npos) {
+				throw std::logic_error("embedded CSS: unexpected end of data");
+			}
+
+			h.on_declaration(name, trim(css.substr(i, value_end - i)));
+
+			i = value_end;
+			if (css[i] == ';') {
+				++i;
+			}
+		}
+
+		h.on_style_properties_end();
+
+		skip_spaces();
+	}
+}
+
+struct size_counter {
+	sizes result;
+
+	constexpr void on_class(std::string_view)
+	{
+		++this->result.num_classes;
+	}
+
+	constexpr void on_selector(std::string_view, std::string_view)
+	{
+		++this->result.num_selectors;
+	}
+
+	constexpr void on_combinator(cssom::combinator) {}
+
+	constexpr void on_selector_chain_end()
+	{
+		++this->result.num_styles;
+	}
+
+	constexpr void on_declaration(std::string_view, std::string_view)
+	{
+		++this->result.num_declarations;
+	}
+
+	constexpr void on_style_properties_end()
+	{
+		++this->result.num_property_lists;
+	}
+};
+
+template <typename tables_type, typename name_to_id_type>
+struct tables_filler {
+	tables_type result{};
+
+	name_to_id_type name_to_id;
+
+	size_t num_styles = 0;
+	size_t num_selectors = 0;
+	size_t num_classes = 0;
+	size_t num_declarations = 0;
+	size_t num_property_lists = 0;
+
+	// first selector of the current chain
+	size_t chain_begin = 0;
+
+	// first class of the current selector
+	size_t selector_classes_begin = 0;
+
+	// first declaration of the current property list
+	size_t declarations_begin = 0;
+
+	constexpr tables_filler(name_to_id_type name_to_id) :
+		name_to_id(name_to_id)
+	{}
+
+	constexpr void on_class(std::string_view name)
+	{
+		this->result.classes[this->num_classes] = name;
+		++this->num_classes;
+	}
+
+	constexpr void on_selector(std::string_view tag, std::string_view id)
+	{
+		auto& sel = this->result.selectors[this->num_selectors];
+		sel.tag = tag;
+		sel.id = id;
+		sel.classes.begin = uint32_t(this->selector_classes_begin);
+		sel.classes.end = uint32_t(this->num_classes);
+		++this->num_selectors;
+		this->selector_classes_begin = this->num_classes;
+	}
+
+	constexpr void on_combinator(cssom::combinator c)
+	{
+		this->result.selectors[this->num_selectors - 1].combinator = c;
+	}
+
+	constexpr void on_selector_chain_end()
+	{
+		// same as cssom::calculate_specificity()
+		unsigned num_ids = 0;
+		unsigned num_class_selectors = 0;
+		unsigned num_types = 0;
+		for (size_t i = this->chain_begin; i != this->num_selectors; ++i) {
+			const auto& sel = this->result.selectors[i];
+			if (!sel.id.empty()) {
+				++num_ids;
+			}
+			if (!sel.tag.empty() && sel.tag.back() != '*') {
+				++num_types;
+			}
+			num_class_selectors += sel.classes.end - sel.classes.begin;
+		}
+
+		auto cap = [](unsigned v) {
+			return uint32_t(v < utki::byte_mask ? v : utki::byte_mask);
+		};
+
+		auto& st = this->result.styles[this->num_styles];
+		st.selectors.begin = uint32_t(this->chain_begin);
+		st.selectors.end = uint32_t(this->num_selectors);
+		st.properties_index = uint32_t(this->num_property_lists);
+		st.specificity = (cap(num_ids) << (utki::byte_bits * 2)) | (cap(num_class_selectors) << utki::byte_bits) |
+			cap(num_types);
+		++this->num_styles;
+		this->chain_begin = this->num_selectors;
+	}
+
+	constexpr void on_declaration(std::string_view name, std::string_view value)
+	{
+		auto& d = this->result.declarations[this->num_declarations];
+		d.property_id = this->name_to_id(name);
+		d.value = value;
+		++this->num_declarations;
+	}
+
+	constexpr void on_style_properties_end()
+	{
+		auto& pl = this->result.property_lists[this->num_property_lists];
+		pl.begin = uint32_t(this->declarations_begin);
+		pl.end = uint32_t(this->num_declarations);
+		++this->num_property_lists;
+		this->declarations_begin = this->num_declarations;
+	}
+};
+
+} // namespace detail
+
+/**
+ * @brief Get sizes of the tables of a CSS source.
+ * @param css - CSS source.
+ * @return sizes of the tables.
+ */
+constexpr sizes get_sizes(std::string_view css)
+{
+	detail::size_counter counter;
+	detail::parse(css, counter);
+	return counter.result;
+}
+
+/**
+ * @brief Parse CSS source into tables.
+ * @tparam tables_type - tables type with sizes given by get_sizes().
+ * @tparam name_to_id_type - type of constexpr function object returning property id by property name.
+ * @param css - CSS source.
+ * @param name_to_id - function returning property id by property name.
+ * @return the tables.
+ */
+template <typename tables_type, typename name_to_id_type>
+constexpr tables_type make_tables(std::string_view css, name_to_id_type name_to_id)
+{
+	detail::tables_filler<tables_type, name_to_id_type> filler(name_to_id);
+	detail::parse(css, filler);
+
+	auto& styles = filler.result.styles;
+
+	// Later rules in the source take precedence over earlier rules of equal specificity,
+	// so reverse the styles and then do stable sort by descending specificity, same as cssom::read() does.
+	for (size_t i = 0, j = styles.size(); i + 1 < j; ++i, --j) {
+		auto t = styles[i];
+		styles[i] = styles[j - 1];
+		styles[j - 1] = t;
+	}
+
+	// insertion sort is stable
+	for (size_t i = 1; i < styles.size(); ++i) {
+		auto st = styles[i];
+		auto j = i;
+		for (; j != 0 && styles[j - 1].specificity < st.specificity; --j) {
+			styles[j] = styles[j - 1];
+		}
+		styles[j] = st;
+	}
+
+	return filler.result;
+}
+
+} // namespace embedded
+
+/**
+ * @brief Style sheet embedded into the program at compile time.
+ * The CSS source is parsed at compile time into read-only tables of selectors and property ids,
+ * which go to the read-only data section of the program. Only a subset of CSS is supported:
+ * type, universal, class and id selectors, combinators and comma separated selector groups.
+ * Malformed or unsupported CSS results in a compilation error.
+ * Property values are kept as text, those are parsed when the run time sheet is made with make_sheet(),
+ * which neither tokenizes the CSS nor sorts the styles.
+ *
+ * Example:
+ * @code{.cpp}
+ * struct default_theme {
+ *     constexpr static std::string_view css = "rect { fill: red; } .big { stroke-width: 3; }";
+ * };
+ *
+ * struct property_name_to_id {
+ *     constexpr uint32_t operator()(std::string_view name) const
+ *     {
+ *         return name == "fill" ? 0 : name == "stroke-width" ? 1 : 2;
+ *     }
+ * };
+ *
+ * using theme = cssom::embedded_sheet<default_theme, property_name_to_id>;
+ *
+ * auto s = theme::make_sheet(parse_property_value);
+ * @endcode
+ *
+ * @tparam source_type - type with static constexpr std::string_view member 'css' holding the CSS source.
+ * @tparam name_to_id_type - default constructible type of function object with constexpr call operator
+ *                           returning property id by property name.
+ */
+template <typename source_type, typename name_to_id_type>
+class embedded_sheet
+{
+	constexpr static embedded::sizes sizes = embedded::get_sizes(source_type::css);
+
+public:
+	using tables_type = embedded::tables<
+		sizes.num_styles,
+		sizes.num_selectors,
+		sizes.num_classes,
+		sizes.num_declarations,
+		sizes.num_property_lists>;
+
+	constexpr static tables_type tables = embedded::make_tables<tables_type>(source_type::css, name_to_id_type{});
+
+	/**
+	 * @brief Make run time sheet.
+	 * @param parse_property_value - function parsing property value, same as for cssom::read().
+	 * @return the sheet, same as cssom::read() would return for the embedded CSS source,
+	 *         except that the property value texts are not normalized.
+	 */
+	static sheet make_sheet(
+		const std::function<property_value_holder(uint32_t, std::string_view)>& parse_property_value
+	)
+	{
+		sheet ret;
+
+		ret.property_lists.reserve(tables.property_lists.size());
+		for (const auto& r : tables.property_lists) {
+			property_list props;
+			props.reserve(r.end - r.begin);
+			for (auto i = r.begin; i != r.end; ++i) {
+				const auto& d = tables.declarations[i];
+				auto value = parse_property_value(d.property_id, d.value);
+				if (value) {
+					props[d.property_id] = std::move(value);
+				}
+			}
+			ret.property_lists.push_back(std::move(props));
+		}
+
+		ret.styles.reserve(tables.styles.size());
+		for (const auto& st : tables.styles) {
+			style s;
+			s.selectors.reserve(st.selectors.end - st.selectors.begin);
+			for (auto i = st.selectors.begin; i != st.selectors.end; ++i) {
+				const auto& e = tables.selectors[i];
+				selector sel;
+				sel.tag = e.tag;
+				sel.id = e.id;
+				sel.classes.reserve(e.classes.end - e.classes.begin);
+				for (auto j = e.classes.begin; j != e.classes.end; ++j) {
+					sel.classes.emplace_back(tables.classes[j]);
+				}
+				sel.combinator = e.combinator;
+				s.selectors.push_back(std::move(sel));
+			}
+			s.properties_index = st.properties_index;
+			s.specificity = st.specificity;
+			ASSERT(s.specificity == calculate_specificity(s.selectors))
+			ret.styles.push_back(std::move(s));
+		}
+
+		return ret;
+	}
+};
+
+} // namespace cssom
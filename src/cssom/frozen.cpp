@@ -0,0 +1,191 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#include "frozen.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include <utki/debug.hpp>
+#include <utki/span.hpp>
+
+#include "instrumentation.hpp"
+
+using namespace cssom;
+
+uint32_t frozen_sheet::add_atom(std::string_view str)
+{
+	auto interned = intern(str);
+	auto res = this->atoms.insert(std::make_pair(interned, uint32_t(this->atoms.size())));
+	return res.first->second;
+}
+
+uint32_t frozen_sheet::find_atom(std::string_view str) const
+{
+	auto i = this->atoms.find(str);
+	if (i == this->atoms.end()) {
+		return unknown_atom;
+	}
+	return i->second;
+}
+
+frozen_sheet::frozen_sheet(sheet s) :
+	source(std::move(s))
+{
+	ASSERT(std::is_sorted(
+		this->source.styles.begin(), //
+		this->source.styles.end(),
+		[](const auto& a, const auto& b) {
+			return a.specificity > b.specificity;
+		}
+	))
+
+	auto num_styles = this->source.styles.size();
+	this->specificities.reserve(num_styles);
+	this->tags.reserve(num_styles);
+	this->ids.reserve(num_styles);
+	this->class_offsets.reserve(num_styles + 1);
+	this->needs_crawler.reserve(num_styles);
+
+	this->class_offsets.push_back(0);
+
+	for (const auto& st : this->source.styles) {
+		ASSERT(!st.selectors.empty())
+		const auto& sel = st.selectors.back();
+
+		this->specificities.push_back(st.specificity);
+
+		if (sel.tag.empty() || sel.tag.back() == '*') {
+			this->tags.push_back(no_atom);
+		} else {
+			this->tags.push_back(this->add_atom(sel.tag));
+		}
+
+		if (sel.id.empty()) {
+			this->ids.push_back(no_atom);
+		} else {
+			this->ids.push_back(this->add_atom(sel.id));
+		}
+
+		for (const auto& c : sel.classes) {
+			this->class_atoms.push_back(this->add_atom(c));
+		}
+		this->class_offsets.push_back(uint32_t(this->class_atoms.size()));
+
+		this->needs_crawler.push_back(
+			st.selectors.size() != 1 || !sel.attributes.empty() || !sel.pseudo_classes.empty()
+		);
+	}
+}
+
+sheet::query_result frozen_sheet::get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const
+{
+	CSSOM_INSTRUMENTATION_COUNT(queries);
+
+	crawler.reset();
+	const auto& node = crawler.get();
+
+	// resolve the node's names to atoms once per query
+	uint32_t tag = this->find_atom(node.get_tag());
+	uint32_t id = node.get_id().empty() ? unknown_atom : this->find_atom(node.get_id());
+
+	// resolve classes to a buffer on stack, so that the query does not allocate memory,
+	// only nodes with a lot of classes fall back to heap
+	constexpr size_t max_stack_classes = 16;
+	std::array<uint32_t, max_stack_classes> stack_classes; // NOLINT(cppcoreguidelines-pro-type-member-init)
+	std::vector<uint32_t> heap_classes;
+
+	auto node_classes = node.get_classes();
+
+	uint32_t* classes_buffer = stack_classes.data();
+	if (node_classes.size() > stack_classes.size()) {
+		heap_classes.resize(node_classes.size());
+		classes_buffer = heap_classes.data();
+	}
+
+	size_t num_classes = 0;
+	for (const auto& c : node_classes) {
+		auto a = this->find_atom(c);
+		if (a != unknown_atom) {
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			classes_buffer[num_classes] = a;
+			++num_classes;
+		}
+	}
+
+	auto classes = utki::make_span(classes_buffer, num_classes);
+
+	auto num_styles = this->specificities.size();
+
+	for (size_t i = 0; i != num_styles; ++i) {
+		CSSOM_INSTRUMENTATION_COUNT(rules_examined);
+
+		if (this->tags[i] != no_atom && this->tags[i] != tag) {
+			CSSOM_INSTRUMENTATION_COUNT(early_rejects);
+			continue;
+		}
+
+		if (this->ids[i] != no_atom && this->ids[i] != id) {
+			CSSOM_INSTRUMENTATION_COUNT(early_rejects);
+			continue;
+		}
+
+		bool has_classes = std::all_of(
+			std::next(this->class_atoms.begin(), std::ptrdiff_t(this->class_offsets[i])),
+			std::next(this->class_atoms.begin(), std::ptrdiff_t(this->class_offsets[i + 1])),
+			[&classes](uint32_t c) {
+				return std::find(classes.begin(), classes.end(), c) != classes.end();
+			}
+		);
+		if (!has_classes) {
+			CSSOM_INSTRUMENTATION_COUNT(early_rejects);
+			continue;
+		}
+
+		const auto& st = this->source.styles[i];
+
+		if (this->needs_crawler[i]) {
+			CSSOM_INSTRUMENTATION_COUNT(crawler_reset_calls);
+			crawler.reset();
+			if (!st.is_matching(crawler)) {
+				continue;
+			}
+		}
+
+		CSSOM_INSTRUMENTATION_COUNT(matches);
+
+		const auto& props = this->source.get_properties(st);
+		auto p = props.find(property_id);
+		if (p != props.end()) {
+			// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+			return sheet::query_result{p->second.get(), this->specificities[i]};
+		}
+	}
+
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	return sheet::query_result{nullptr, 0};
+}
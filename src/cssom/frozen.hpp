@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Read-optimized immutable form of a style sheet.
+ * The rightmost simple selectors of all styles are stored in flat parallel arrays, with tag, id and class names
+ * replaced by integer atoms. Querying a property value resolves the queried node's tag, id and classes to atoms once,
+ * then streams through the arrays checking the rightmost simple selector of each style with integer comparisons,
+ * which rejects most of the styles without touching the crawler.
+ * Only the styles which pass this check and have more than one simple selector or use attribute selectors
+ * or pseudo-classes are matched against the document with the crawler.
+ * Query results are same as of the sheet the frozen sheet was made from.
+ */
+class frozen_sheet
+{
+	// the source sheet, owns the property lists and the selectors used for the full matching
+	sheet source;
+
+	constexpr static uint32_t no_atom = std::numeric_limits<uint32_t>::max();
+	constexpr static uint32_t unknown_atom = no_atom - 1;
+
+	// keys are interned with cssom::intern()
+	std::unordered_map<std::string_view, uint32_t> atoms;
+
+	// Per style arrays, describing the rightmost simple selector of the style.
+
+	std::vector<uint32_t> specificities;
+
+	// no_atom for universal selector
+	std::vector<uint32_t> tags;
+
+	// no_atom if no id is specified
+	std::vector<uint32_t> ids;
+
+	// offsets of the style's classes in the class_atoms, has one extra element in the end,
+	// so that classes of style i are in [class_offsets[i], class_offsets[i + 1])
+	std::vector<uint32_t> class_offsets;
+	std::vector<uint32_t> class_atoms;
+
+	// whether the style has to be matched with the crawler after its rightmost selector has matched,
+	// i.e. the style has more than one simple selector, or its rightmost selector has attribute selectors
+	// or pseudo-classes
+	std::vector<bool> needs_crawler;
+
+	uint32_t add_atom(std::string_view str);
+	uint32_t find_atom(std::string_view str) const;
+
+public:
+	/**
+	 * @brief Create frozen sheet.
+	 * @param s - sheet to freeze. Must be sorted by specificity.
+	 */
+	explicit frozen_sheet(sheet s);
+
+	/**
+	 * @brief Get the sheet the frozen sheet was made from.
+	 * @return the source sheet.
+	 */
+	const sheet& get_sheet() const noexcept
+	{
+		return this->source;
+	}
+
+	/**
+	 * @brief Get property value for given xml document node.
+	 * Same as sheet::get_property_value().
+	 * @param crawler - crawler pointing to the node to get the property value for.
+	 * @param property_id - id of the property to get.
+	 * @return query result.
+	 */
+	sheet::query_result get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const;
+};
+
+} // namespace cssom
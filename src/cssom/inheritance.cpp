@@ -0,0 +1,94 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#include "inheritance.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+using namespace cssom;
+
+inheritance_resolver::inheritance_resolver(const sheet& styles, std::vector<uint32_t> inherited_property_ids) :
+	styles(styles),
+	inherited_property_ids(std::move(inherited_property_ids))
+{
+	// sorted ids are needed for binary search in get()
+	std::sort(this->inherited_property_ids.begin(), this->inherited_property_ids.end());
+	this->inherited_property_ids.erase(
+		std::unique(this->inherited_property_ids.begin(), this->inherited_property_ids.end()),
+		this->inherited_property_ids.end()
+	);
+}
+
+void inheritance_resolver::push(xml_dom_crawler& crawler)
+{
+	auto num_ids = this->inherited_property_ids.size();
+
+	auto begin = this->values.size();
+	this->values.resize(begin + num_ids);
+
+	auto node_values = utki::make_span(this->values).subspan(begin);
+
+	auto num_resolved = this->styles.get_property_values(
+		crawler, //
+		utki::make_span(this->inherited_property_ids),
+		node_values
+	);
+
+	if (num_resolved != num_ids && this->depth != 0) {
+		auto parent_values = utki::make_span(this->values).subspan(begin - num_ids, num_ids);
+		for (size_t i = 0; i != num_ids; ++i) {
+			if (!node_values[i].value) {
+				node_values[i] = parent_values[i];
+			}
+		}
+	}
+
+	++this->depth;
+}
+
+void inheritance_resolver::pop()
+{
+	ASSERT(this->depth != 0)
+	--this->depth;
+	this->values.resize(this->depth * this->inherited_property_ids.size());
+}
+
+sheet::query_result inheritance_resolver::get(uint32_t property_id) const noexcept
+{
+	auto i = std::lower_bound(this->inherited_property_ids.begin(), this->inherited_property_ids.end(), property_id);
+	if (this->depth == 0 || i == this->inherited_property_ids.end() || *i != property_id) {
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		return sheet::query_result{nullptr, 0};
+	}
+
+	auto index = (this->depth - 1) * this->inherited_property_ids.size() +
+		size_t(std::distance(this->inherited_property_ids.begin(), i));
+	ASSERT(index < this->values.size())
+	return this->values[index];
+}
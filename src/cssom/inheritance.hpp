@@ -0,0 +1,99 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <vector>
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Resolver of inherited properties during a document walk.
+ * Inherited properties, like 'fill' or 'stroke' in SVG, take their value from the nearest ancestor which
+ * has the property defined, when the node itself does not have it defined.
+ * The resolver keeps the values of inherited properties for each node on the path from the document root
+ * to the current node of the walk, so each node is matched against the sheet only once per walk,
+ * instead of once per each of its descendants.
+ *
+ * Usage: while walking the document depth-first, call push() when entering a node and pop() when leaving it,
+ * then the inherited property values of the node are available via get() between the calls.
+ */
+class inheritance_resolver
+{
+	const sheet& styles;
+
+	std::vector<uint32_t> inherited_property_ids;
+
+	// Resolved values of the inherited properties, for each node on the path from root to current node.
+	// Values of the node at depth d are at [d * inherited_property_ids.size(), (d + 1) * inherited_property_ids.size()).
+	std::vector<sheet::query_result> values;
+
+	size_t depth = 0;
+
+public:
+	/**
+	 * @brief Create resolver.
+	 * @param styles - sheet to resolve properties from. Must outlive the resolver.
+	 * @param inherited_property_ids - ids of the inherited properties.
+	 */
+	inheritance_resolver(const sheet& styles, std::vector<uint32_t> inherited_property_ids);
+
+	/**
+	 * @brief Enter a child node of the current node.
+	 * Resolves the inherited properties of the node, the ones not defined for the node are taken from the parent node.
+	 * @param crawler - crawler pointing to the node being entered.
+	 */
+	void push(xml_dom_crawler& crawler);
+
+	/**
+	 * @brief Leave the current node, going back to its parent node.
+	 */
+	void pop();
+
+	/**
+	 * @brief Get the current depth of the walk.
+	 * @return number of nodes entered and not yet left.
+	 */
+	size_t get_depth() const noexcept
+	{
+		return this->depth;
+	}
+
+	/**
+	 * @brief Get value of inherited property for the current node.
+	 * @param property_id - id of the inherited property.
+	 * @return query result of the nearest node on the path from the current node to the root which defines the
+	 *         property, the specificity is of the matched style of that node.
+	 * @return query result with nullptr value if none of the nodes defines the property,
+	 *         or if the property is not in the inherited property ids, or if no node has been entered.
+	 */
+	sheet::query_result get(uint32_t property_id) const noexcept;
+};
+
+} // namespace cssom
@@ -0,0 +1,136 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "instrumentation.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "om.hpp"
+
+using namespace cssom::instrumentation;
+
+namespace {
+thread_local counters thread_counters;
+thread_local bool thread_profiling_enabled = false;
+thread_local std::unordered_map<const cssom::style*, style_profile> thread_style_profiles;
+} // namespace
+
+bool cssom::instrumentation::is_enabled() noexcept
+{
+#ifdef CSSOM_INSTRUMENTATION
+	return true;
+#else
+	return false;
+#endif
+}
+
+const counters& cssom::instrumentation::get_counters() noexcept
+{
+	return thread_counters;
+}
+
+void cssom::instrumentation::reset_counters() noexcept
+{
+	thread_counters = counters();
+}
+
+counters& cssom::instrumentation::detail::get_mutable_counters() noexcept
+{
+	return thread_counters;
+}
+
+void cssom::instrumentation::set_profiling_enabled(bool enable) noexcept
+{
+	thread_profiling_enabled = enable;
+}
+
+bool cssom::instrumentation::is_profiling_enabled() noexcept
+{
+	return thread_profiling_enabled;
+}
+
+const std::unordered_map<const cssom::style*, style_profile>& cssom::instrumentation::get_style_profiles() noexcept
+{
+	return thread_style_profiles;
+}
+
+void cssom::instrumentation::reset_style_profiles() noexcept
+{
+	thread_style_profiles.clear();
+}
+
+std::string cssom::instrumentation::make_profile_report(size_t max_entries)
+{
+	std::vector<std::pair<const style*, const style_profile*>> ranked;
+	ranked.reserve(thread_style_profiles.size());
+	for (const auto& p : thread_style_profiles) {
+		ranked.emplace_back(p.first, &p.second);
+	}
+
+	std::sort(
+		ranked.begin(), //
+		ranked.end(),
+		[](const auto& a, const auto& b) {
+			return a.second->time > b.second->time;
+		}
+	);
+
+	if (max_entries != 0 && ranked.size() > max_entries) {
+		ranked.resize(max_entries);
+	}
+
+	std::string ret;
+	for (const auto& r : ranked) {
+		ret.append(r.first->get_name())
+			.append(": attempts=")
+			.append(std::to_string(r.second->attempts))
+			.append(" successes=")
+			.append(std::to_string(r.second->successes))
+			.append(" crawler_steps=")
+			.append(std::to_string(r.second->crawler_steps))
+			.append(" time_ns=")
+			.append(std::to_string(r.second->time.count()))
+			.append("\n");
+	}
+	return ret;
+}
+
+void cssom::instrumentation::detail::record_style_matching(
+	const style& st,
+	bool matched,
+	uint64_t crawler_steps,
+	std::chrono::nanoseconds time
+)
+{
+	auto& p = thread_style_profiles[&st];
+	++p.attempts;
+	if (matched) {
+		++p.successes;
+	}
+	p.crawler_steps += crawler_steps;
+	p.time += time;
+}
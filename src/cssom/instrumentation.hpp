@@ -0,0 +1,189 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Instrumentation of matching hot paths.
+ * The instrumentation is only compiled in when the library is built with CSSOM_INSTRUMENTATION macro defined,
+ * otherwise the counting is compiled out completely and all the counters stay zero.
+ */
+
+namespace cssom {
+struct style;
+} // namespace cssom
+
+namespace cssom::instrumentation {
+
+/**
+ * @brief Matching counters.
+ */
+struct counters {
+	/**
+	 * @brief Number of property value queries.
+	 */
+	uint64_t queries = 0;
+
+	/**
+	 * @brief Number of styles examined by the queries.
+	 */
+	uint64_t rules_examined = 0;
+
+	/**
+	 * @brief Number of selector::is_matching() calls.
+	 */
+	uint64_t selector_matching_calls = 0;
+
+	/**
+	 * @brief Number of xml_dom_crawler::move_up() calls.
+	 */
+	uint64_t crawler_move_up_calls = 0;
+
+	/**
+	 * @brief Number of xml_dom_crawler::move_left() calls.
+	 */
+	uint64_t crawler_move_left_calls = 0;
+
+	/**
+	 * @brief Number of xml_dom_crawler::reset() calls.
+	 */
+	uint64_t crawler_reset_calls = 0;
+
+	/**
+	 * @brief Number of styles rejected by the rightmost selector of their selector chain.
+	 */
+	uint64_t early_rejects = 0;
+
+	/**
+	 * @brief Number of styles which matched.
+	 */
+	uint64_t matches = 0;
+};
+
+/**
+ * @brief Check if the library was built with instrumentation.
+ * @return true if the library was built with CSSOM_INSTRUMENTATION defined.
+ */
+bool is_enabled() noexcept;
+
+/**
+ * @brief Get counters of the calling thread.
+ * The counters accumulate until reset with reset_counters().
+ * @return counters of the calling thread.
+ */
+const counters& get_counters() noexcept;
+
+/**
+ * @brief Reset counters of the calling thread to zero.
+ */
+void reset_counters() noexcept;
+
+/**
+ * @brief Matching profile of a single style.
+ */
+struct style_profile {
+	/**
+	 * @brief Number of style::is_matching() calls.
+	 */
+	uint64_t attempts = 0;
+
+	/**
+	 * @brief Number of style::is_matching() calls which returned true.
+	 */
+	uint64_t successes = 0;
+
+	/**
+	 * @brief Number of crawler moves done by style::is_matching() calls.
+	 */
+	uint64_t crawler_steps = 0;
+
+	/**
+	 * @brief Total time spent in style::is_matching() calls.
+	 */
+	std::chrono::nanoseconds time{0};
+};
+
+/**
+ * @brief Enable or disable per style profiling for the calling thread.
+ * Profiling measures time of each style::is_matching() call, so it is disabled by default
+ * even when the library is built with instrumentation.
+ * Has no effect if the library is built without instrumentation.
+ * @param enable - whether to enable profiling.
+ */
+void set_profiling_enabled(bool enable) noexcept;
+
+/**
+ * @brief Check if per style profiling is enabled for the calling thread.
+ * @return true if profiling is enabled.
+ */
+bool is_profiling_enabled() noexcept;
+
+/**
+ * @brief Get per style profiles collected by the calling thread.
+ * The profiles are keyed by style address, so the profiled sheets must not be modified
+ * while the profiles are in use.
+ * @return per style profiles.
+ */
+const std::unordered_map<const style*, style_profile>& get_style_profiles() noexcept;
+
+/**
+ * @brief Clear per style profiles of the calling thread.
+ */
+void reset_style_profiles() noexcept;
+
+/**
+ * @brief Make human readable report of per style profiles.
+ * The styles are ranked by time spent in matching, most expensive first.
+ * Each line of the report has the selector text of the style followed by its profile.
+ * The profiled styles must still be alive.
+ * @param max_entries - maximum number of styles to report, 0 means all.
+ * @return the report.
+ */
+std::string make_profile_report(size_t max_entries = 0);
+
+namespace detail {
+counters& get_mutable_counters() noexcept;
+
+void record_style_matching(
+	const style& st,
+	bool matched,
+	uint64_t crawler_steps,
+	std::chrono::nanoseconds time
+);
+} // namespace detail
+
+} // namespace cssom::instrumentation
+
+#ifdef CSSOM_INSTRUMENTATION
+#	define CSSOM_INSTRUMENTATION_COUNT(counter) (++cssom::instrumentation::detail::get_mutable_counters().counter)
+#else
+#	define CSSOM_INSTRUMENTATION_COUNT(counter)
+#endif
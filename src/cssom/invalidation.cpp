@@ -0,0 +1,246 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "invalidation.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+using namespace cssom;
+
+namespace {
+// Calculate which nodes are affected when a node starts or stops matching the selector
+// at given position of the selector chain.
+invalidation get_invalidation(const selector_chain& chain, size_t index)
+{
+	ASSERT(index < chain.size())
+
+	invalidation ret;
+
+	if (index + 1 == chain.size()) {
+		ret.self = true;
+		return ret;
+	}
+
+	switch (chain[index].combinator) {
+		case combinator::descendant:
+		case combinator::child:
+			ret.descendants = true;
+			break;
+		case combinator::next_sibling:
+		case combinator::subsequent_sibling:
+			ret.siblings = true;
+			for (auto i = std::next(chain.begin(), std::ptrdiff_t(index + 1)); i != chain.end(); ++i) {
+				if (i->combinator == combinator::descendant || i->combinator == combinator::child) {
+					ret.sibling_descendants = true;
+					break;
+				}
+			}
+			break;
+		case combinator::none:
+		default:
+			ASSERT(false)
+			break;
+	}
+
+	return ret;
+}
+} // namespace
+
+invalidation_map::invalidation_map(const sheet& s)
+{
+	for (const auto& st : s.styles) {
+		this->add(st);
+	}
+}
+
+void invalidation_map::counter::add(const invalidation& inv) noexcept
+{
+	this->self += size_t(inv.self);
+	this->descendants += size_t(inv.descendants);
+	this->siblings += size_t(inv.siblings);
+	this->sibling_descendants += size_t(inv.sibling_descendants);
+}
+
+void invalidation_map::counter::remove(const invalidation& inv) noexcept
+{
+	ASSERT(this->self >= size_t(inv.self))
+	ASSERT(this->descendants >= size_t(inv.descendants))
+	ASSERT(this->siblings >= size_t(inv.siblings))
+	ASSERT(this->sibling_descendants >= size_t(inv.sibling_descendants))
+
+	this->self -= size_t(inv.self);
+	this->descendants -= size_t(inv.descendants);
+	this->siblings -= size_t(inv.siblings);
+	this->sibling_descendants -= size_t(inv.sibling_descendants);
+}
+
+namespace {
+void update_counter(
+	std::map<std::string, invalidation_map::counter, std::less<>>& map,
+	std::string key,
+	const invalidation& inv,
+	bool add
+)
+{
+	if (add) {
+		map[std::move(key)].add(inv);
+		return;
+	}
+
+	auto i = map.find(key);
+	ASSERT(i != map.end())
+	i->second.remove(inv);
+	if (i->second.is_empty()) {
+		map.erase(i);
+	}
+}
+} // namespace
+
+void invalidation_map::add(const style& s)
+{
+	this->update(s, true);
+}
+
+void invalidation_map::remove(const style& s)
+{
+	this->update(s, false);
+}
+
+void invalidation_map::update(const style& s, bool add)
+{
+	auto update_structural = [this, add](const invalidation& inv) {
+		if (add) {
+			this->structural.add(inv);
+		} else {
+			this->structural.remove(inv);
+		}
+	};
+
+	for (size_t i = 0; i != s.selectors.size(); ++i) {
+		const auto& sel = s.selectors[i];
+
+		auto inv = get_invalidation(s.selectors, i);
+
+		for (const auto& c : sel.classes) {
+			update_counter(this->classes, c, inv, add);
+		}
+
+		if (!sel.id.empty()) {
+			update_counter(this->ids, sel.id, inv, add);
+		}
+
+		if (!sel.tag.empty() && sel.tag.back() != '*') {
+			update_counter(this->tags, sel.tag, inv, add);
+		}
+
+		for (const auto& a : sel.attributes) {
+			update_counter(this->attributes, std::string(a.name), inv, add);
+		}
+
+		// Structural pseudo-classes of the selector depend on the node's siblings,
+		// so changing list of children can affect each of the children.
+		if (std::any_of(sel.pseudo_classes.begin(), sel.pseudo_classes.end(), [](const auto& pc) {
+				return pc.type != pseudo_class_type::unsupported;
+			}))
+		{
+			update_structural(inv);
+		}
+
+		// Inserting or removing a child changes which nodes are siblings to each other.
+		if (sel.combinator == combinator::next_sibling || sel.combinator == combinator::subsequent_sibling) {
+			update_structural(get_invalidation(s.selectors, i + 1));
+		}
+	}
+}
+
+namespace {
+invalidation find(const std::map<std::string, invalidation_map::counter, std::less<>>& map, std::string_view key)
+{
+	if (key.empty()) {
+		return {};
+	}
+
+	auto i = map.find(key);
+	if (i == map.end()) {
+		return {};
+	}
+	return i->second.get();
+}
+} // namespace
+
+invalidation invalidation_map::classes_changed(
+	utki::span<const std::string> old_classes, //
+	utki::span<const std::string> new_classes
+) const
+{
+	invalidation ret;
+
+	auto add_difference = [this, &ret](utki::span<const std::string> a, utki::span<const std::string> b) {
+		for (const auto& c : a) {
+			if (std::find(b.begin(), b.end(), c) != b.end()) {
+				// class is present in both lists, not changed
+				continue;
+			}
+			ret |= find(this->classes, c);
+		}
+	};
+
+	add_difference(old_classes, new_classes);
+	add_difference(new_classes, old_classes);
+
+	return ret;
+}
+
+invalidation invalidation_map::id_changed(std::string_view old_id, std::string_view new_id) const
+{
+	if (old_id == new_id) {
+		return {};
+	}
+
+	auto ret = find(this->ids, old_id);
+	ret |= find(this->ids, new_id);
+	return ret;
+}
+
+invalidation invalidation_map::tag_changed(std::string_view old_tag, std::string_view new_tag) const
+{
+	if (old_tag == new_tag) {
+		return {};
+	}
+
+	auto ret = find(this->tags, old_tag);
+	ret |= find(this->tags, new_tag);
+
+	// universal selectors do not depend on tag, so need not to be taken into account
+	return ret;
+}
+
+invalidation invalidation_map::attribute_changed(std::string_view name) const
+{
+	return find(this->attributes, name);
+}
@@ -0,0 +1,195 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <map>
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Scope of style invalidation.
+ * Describes which nodes, relative to a mutated node, need their styles to be re-queried.
+ */
+struct invalidation {
+	/**
+	 * @brief The mutated node itself.
+	 */
+	bool self = false;
+
+	/**
+	 * @brief All descendants of the mutated node.
+	 */
+	bool descendants = false;
+
+	/**
+	 * @brief All following siblings of the mutated node.
+	 */
+	bool siblings = false;
+
+	/**
+	 * @brief All descendants of the following siblings of the mutated node.
+	 */
+	bool sibling_descendants = false;
+
+	bool is_empty() const noexcept
+	{
+		return !this->self && !this->descendants && !this->siblings && !this->sibling_descendants;
+	}
+
+	invalidation& operator|=(const invalidation& i) noexcept
+	{
+		this->self |= i.self;
+		this->descendants |= i.descendants;
+		this->siblings |= i.siblings;
+		this->sibling_descendants |= i.sibling_descendants;
+		return *this;
+	}
+};
+
+/**
+ * @brief Style invalidation metadata of a style sheet.
+ * For each class, id, tag and attribute name mentioned in the sheet's selectors,
+ * records which nodes are affected when a node gets or loses that feature.
+ * This allows re-querying styles of only those nodes which might be affected by a DOM mutation,
+ * instead of the whole document.
+ */
+class invalidation_map
+{
+public:
+	/**
+	 * @brief Number of selectors contributing to each of the invalidation flags.
+	 * Counting allows removing styles from the map without rebuilding it.
+	 */
+	struct counter {
+		size_t self = 0;
+		size_t descendants = 0;
+		size_t siblings = 0;
+		size_t sibling_descendants = 0;
+
+		void add(const invalidation& inv) noexcept;
+		void remove(const invalidation& inv) noexcept;
+
+		bool is_empty() const noexcept
+		{
+			return this->get().is_empty();
+		}
+
+		invalidation get() const noexcept
+		{
+			invalidation ret;
+			ret.self = this->self != 0;
+			ret.descendants = this->descendants != 0;
+			ret.siblings = this->siblings != 0;
+			ret.sibling_descendants = this->sibling_descendants != 0;
+			return ret;
+		}
+	};
+
+private:
+	std::map<std::string, counter, std::less<>> classes;
+	std::map<std::string, counter, std::less<>> ids;
+	std::map<std::string, counter, std::less<>> tags;
+	std::map<std::string, counter, std::less<>> attributes;
+
+	// invalidation of the children of a node whose list of children has changed
+	counter structural;
+
+	void update(const style& s, bool add);
+
+public:
+	invalidation_map() = default;
+
+	/**
+	 * @brief Build invalidation map from style sheet.
+	 * @param s - style sheet to build the invalidation map from.
+	 */
+	invalidation_map(const sheet& s);
+
+	/**
+	 * @brief Add invalidation metadata of a style.
+	 * To be called when the style is inserted to the sheet, see sheet::insert_style().
+	 * @param s - style to add.
+	 */
+	void add(const style& s);
+
+	/**
+	 * @brief Remove invalidation metadata of a style.
+	 * To be called when the style is removed from the sheet, see sheet::remove_style().
+	 * The style must have been previously added to the map.
+	 * @param s - style to remove.
+	 */
+	void remove(const style& s);
+
+	/**
+	 * @brief Get invalidation caused by change of node's class list.
+	 * Only the classes which were added or removed are taken into account.
+	 * @param old_classes - class list of the node before the mutation.
+	 * @param new_classes - class list of the node after the mutation.
+	 * @return invalidation scope relative to the mutated node.
+	 */
+	invalidation classes_changed(
+		utki::span<const std::string> old_classes, //
+		utki::span<const std::string> new_classes
+	) const;
+
+	/**
+	 * @brief Get invalidation caused by change of node's id.
+	 * @param old_id - id of the node before the mutation.
+	 * @param new_id - id of the node after the mutation.
+	 * @return invalidation scope relative to the mutated node.
+	 */
+	invalidation id_changed(std::string_view old_id, std::string_view new_id) const;
+
+	/**
+	 * @brief Get invalidation caused by change of node's tag.
+	 * @param old_tag - tag of the node before the mutation.
+	 * @param new_tag - tag of the node after the mutation.
+	 * @return invalidation scope relative to the mutated node.
+	 */
+	invalidation tag_changed(std::string_view old_tag, std::string_view new_tag) const;
+
+	/**
+	 * @brief Get invalidation caused by change of node's attribute.
+	 * @param name - name of the attribute which has been added, removed or changed its value.
+	 * @return invalidation scope relative to the mutated node.
+	 */
+	invalidation attribute_changed(std::string_view name) const;
+
+	/**
+	 * @brief Get invalidation caused by insertion or removal of node's children.
+	 * Such mutation can affect structural pseudo-classes and sibling combinators.
+	 * @return invalidation scope relative to each child of the mutated node.
+	 */
+	invalidation children_changed() const noexcept
+	{
+		return this->structural.get();
+	}
+};
+
+} // namespace cssom
@@ -0,0 +1,269 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <utki/debug.hpp>
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Holder of a live object which can be replaced while being read by other threads.
+ * Typically the object is a style sheet, possibly along with indexes built on top of it,
+ * which is queried by many threads while it can be reloaded at any moment.
+ * Writers build a new object completely and then publish it, readers get pinned snapshots
+ * of the object which stay valid as long as readers hold them. Old versions are freed
+ * when the last reader releases its snapshot.
+ *
+ * Progress guarantees: taking a snapshot, i.e. live::get() and live::reader::get(), is wait-free.
+ * It takes a fixed number of atomic operations, without locks or retry loops.
+ * Releasing the last snapshot of an old version destroys the object in the releasing thread,
+ * same as with any std::shared_ptr.
+ * Publishing is blocking: concurrent publish() calls are serialized, and a publish() may
+ * wait for readers which are in the middle of taking a snapshot of one of the older versions.
+ *
+ * The published versions are kept in a small fixed set of slots. The current slot index and the number
+ * of snapshots taken from it are packed into a single atomic word, so a reader takes a snapshot
+ * with a single atomic increment of that word, which also pins the slot.
+ * When a new version is published, the number of snapshots taken from the old slot is transferred to
+ * the slot's own reference count, and the slot becomes free when all the readers have unpinned it.
+ * @tparam T - type of the held object.
+ */
+template <typename T>
+class live
+{
+	constexpr static size_t num_slots = 4;
+	constexpr static unsigned index_shift = 56;
+	constexpr static uint64_t count_mask = (uint64_t(1) << index_shift) - 1;
+
+	static_assert(num_slots <= (uint64_t(1) << (sizeof(uint64_t) * 8 - index_shift)), "too many slots");
+
+	// Reference count of the current slot is biased, so that it does not reach zero
+	// until the number of taken snapshots is transferred to it on publishing a new version.
+	constexpr static int64_t bias = int64_t(1) << 62;
+
+	struct slot {
+		std::shared_ptr<const T> object;
+
+		// number of pins transferred from the current word minus number of unpins, plus the bias,
+		// if the slot is the current one
+		std::atomic<int64_t> refs{0};
+
+		std::atomic<bool> is_free{true};
+	};
+
+	mutable std::array<slot, num_slots> slots;
+
+	// index of the current slot along with number of snapshots taken from it
+	mutable std::atomic<uint64_t> current{0};
+
+	std::atomic<uint64_t> version{0};
+
+	std::mutex publish_mutex;
+
+	static void free_slot(slot& s) noexcept
+	{
+		s.object.reset();
+		s.is_free.store(true, std::memory_order_release);
+	}
+
+	static void unpin(slot& s) noexcept
+	{
+		if (s.refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			free_slot(s);
+		}
+	}
+
+	size_t acquire_free_slot() noexcept
+	{
+		auto current_index = size_t(this->current.load(std::memory_order_relaxed) >> index_shift);
+
+		// old slots are pinned only while readers are copying the snapshot out of them, so waiting is short
+		while (true) {
+			for (size_t i = 0; i != this->slots.size(); ++i) {
+				if (i == current_index) {
+					continue;
+				}
+				if (this->slots[i].is_free.load(std::memory_order_acquire)) {
+					this->slots[i].is_free.store(false, std::memory_order_relaxed);
+					return i;
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void init(std::shared_ptr<const T> value) noexcept
+	{
+		ASSERT(value)
+		auto& s = this->slots.front();
+		s.object = std::move(value);
+		s.refs.store(bias, std::memory_order_relaxed);
+		s.is_free.store(false, std::memory_order_relaxed);
+	}
+
+public:
+	/**
+	 * @brief Reader of a live object.
+	 * Caches the pinned snapshot and re-pins it only when a new version is published.
+	 * So, in steady state, reading is a single atomic load of the version number.
+	 * The reader object itself is not thread-safe, each thread is supposed to have its own reader.
+	 */
+	class reader
+	{
+		const live& owner;
+		std::shared_ptr<const T> snapshot;
+		uint64_t snapshot_version;
+
+	public:
+		reader(const live& owner) :
+			owner(owner),
+			snapshot_version(owner.get_version())
+		{
+			this->snapshot = owner.get();
+		}
+
+		/**
+		 * @brief Get the latest published object.
+		 * The returned reference stays valid until next call to this function or until the reader is destroyed.
+		 * @return the latest published object.
+		 */
+		const T& get()
+		{
+			auto v = this->owner.get_version();
+			if (v != this->snapshot_version) {
+				this->snapshot = this->owner.get();
+				this->snapshot_version = v;
+			}
+			ASSERT(this->snapshot)
+			return *this->snapshot;
+		}
+	};
+
+	live()
+	{
+		this->init(std::make_shared<const T>());
+	}
+
+	live(std::shared_ptr<const T> value)
+	{
+		this->init(std::move(value));
+	}
+
+	live(const live&) = delete;
+	live& operator=(const live&) = delete;
+
+	live(live&&) = delete;
+	live& operator=(live&&) = delete;
+
+	~live() noexcept = default;
+
+	/**
+	 * @brief Get pinned snapshot of the object.
+	 * The snapshot stays valid as long as it is held, even if a new version is published meanwhile.
+	 * @return snapshot of the latest published object.
+	 */
+	std::shared_ptr<const T> get() const noexcept
+	{
+		auto w = this->current.fetch_add(1, std::memory_order_acquire);
+		// the snapshot counter must not overflow into the slot index
+		ASSERT((w & count_mask) != count_mask)
+
+		auto& s = this->slots[w >> index_shift];
+
+		// the slot is pinned, so its object is not changed until it is unpinned
+		auto ret = s.object;
+
+		unpin(s);
+
+		ASSERT(ret)
+		return ret;
+	}
+
+	/**
+	 * @brief Get version number of the latest published object.
+	 * The version number is incremented each time a new object is published.
+	 * @return version number.
+	 */
+	uint64_t get_version() const noexcept
+	{
+		return this->version.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * @brief Publish new version of the object.
+	 * The object must be completely built before publishing, since it can be read by other threads
+	 * right after publishing and it is not supposed to be modified after that.
+	 * @param value - new version of the object.
+	 */
+	void publish(std::shared_ptr<const T> value)
+	{
+		ASSERT(value)
+
+		std::lock_guard lock(this->publish_mutex);
+
+		auto i = this->acquire_free_slot();
+		auto& s = this->slots[i];
+		s.object = std::move(value);
+		s.refs.store(bias, std::memory_order_relaxed);
+
+		auto old = this->current.exchange(uint64_t(i) << index_shift, std::memory_order_acq_rel);
+
+		auto& old_slot = this->slots[old >> index_shift];
+
+		// transfer the number of pins taken from the old slot to its reference count and remove the bias
+		auto num_pins = int64_t(old & count_mask);
+		if (old_slot.refs.fetch_add(num_pins - bias, std::memory_order_acq_rel) + num_pins - bias == 0) {
+			free_slot(old_slot);
+		}
+
+		this->version.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	/**
+	 * @brief Publish new version of the object.
+	 * @param value - new version of the object.
+	 */
+	void publish(T value)
+	{
+		this->publish(std::make_shared<const T>(std::move(value)));
+	}
+};
+
+/**
+ * @brief Live style sheet.
+ */
+using live_sheet = live<sheet>;
+
+} // namespace cssom
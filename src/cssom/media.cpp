@@ -0,0 +1,457 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#include "media.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <sstream>
+
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "instrumentation.hpp"
+#include "query.hpp"
+#include "parser.hpp"
+
+using namespace cssom;
+
+bool media_expression::is_active(const media_environment& env) const
+{
+	switch (this->type) {
+		case media_feature_type::named:
+			return env.features.find(this->name) != env.features.end();
+		case media_feature_type::width:
+			return this->min <= env.width && env.width <= this->max;
+		case media_feature_type::height:
+			return this->min <= env.height && env.height <= this->max;
+		case media_feature_type::resolution:
+			return this->min <= env.dpi && env.dpi <= this->max;
+		case media_feature_type::portrait:
+			return env.height >= env.width;
+		case media_feature_type::landscape:
+			return env.width > env.height;
+	}
+	return false;
+}
+
+bool media_query::is_active(const media_environment& env) const
+{
+	bool all = std::all_of(this->expressions.begin(), this->expressions.end(), [&env](const auto& e) {
+		return e.is_active(env);
+	});
+	return all != this->negated;
+}
+
+bool media_condition::is_active(const media_environment& env) const
+{
+	if (this->queries.empty()) {
+		return true;
+	}
+	return std::any_of(this->queries.begin(), this->queries.end(), [&env](const auto& q) {
+		return q.is_active(env);
+	});
+}
+
+namespace {
+void set_error(std::string& error, std::string_view text, std::string_view what)
+{
+	std::stringstream ss;
+	ss << "malformed media condition '" << text << "': " << what;
+	error = ss.str();
+}
+} // namespace
+
+namespace {
+// parses value with unit, e.g. "600px", returns the value converted by the unit's factor,
+// or nothing if the value is malformed, in which case the error message is set
+std::optional<double> parse_dimension(
+	std::string_view text,
+	std::string_view value,
+	const std::vector<std::pair<std::string_view, double>>& units,
+	std::string& error
+)
+{
+	std::string str(value);
+	char* end = nullptr;
+	double number = std::strtod(str.c_str(), &end);
+	if (end == str.c_str()) {
+		set_error(error, text, "number expected");
+		return std::nullopt;
+	}
+
+	auto unit = utki::trim(std::string_view(end));
+
+	for (const auto& u : units) {
+		if (u.first == unit) {
+			return number * u.second;
+		}
+	}
+
+	set_error(error, text, "unknown unit");
+	return std::nullopt;
+}
+} // namespace
+
+namespace {
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers, "unit conversion factors")
+const std::vector<std::pair<std::string_view, double>> length_units = {
+	{"",    1          },
+	{"px",  1          },
+	{"em",  16         },
+	{"rem", 16         },
+	{"in",  96         },
+	{"cm",  96 / 2.54  },
+	{"mm",  96 / 25.4  },
+	{"pt",  96.0 / 72  }
+};
+
+const std::vector<std::pair<std::string_view, double>> resolution_units = {
+	{"dpi",  1   },
+	{"dpcm", 2.54},
+	{"dppx", 96  },
+	{"x",    96  }
+};
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
+} // namespace
+
+namespace {
+// parses contents of parentheses, e.g. "min-width: 600px"
+std::optional<media_expression> parse_media_expression(std::string_view text, std::string_view str, std::string& error)
+{
+	media_expression ret;
+
+	auto colon_pos = str.find(':');
+	if (colon_pos == std::string_view::npos) {
+		// boolean feature
+		ret.name = std::string(utki::trim(str));
+		if (ret.name.empty()) {
+			set_error(error, text, "empty media feature");
+			return std::nullopt;
+		}
+		return ret;
+	}
+
+	auto name = utki::trim(str.substr(0, colon_pos));
+	auto value = utki::trim(str.substr(colon_pos + 1));
+	if (name.empty() || value.empty()) {
+		set_error(error, text, "media feature name and value expected");
+		return std::nullopt;
+	}
+
+	enum class range {
+		exact,
+		min,
+		max
+	};
+
+	auto r = range::exact;
+	auto base_name = name;
+	if (name.substr(0, 4) == "min-") {
+		r = range::min;
+		base_name = name.substr(4);
+	} else if (name.substr(0, 4) == "max-") {
+		r = range::max;
+		base_name = name.substr(4);
+	}
+
+	const std::vector<std::pair<std::string_view, double>>* units = nullptr;
+
+	if (base_name == "width") {
+		ret.type = media_feature_type::width;
+		units = &length_units;
+	} else if (base_name == "height") {
+		ret.type = media_feature_type::height;
+		units = &length_units;
+	} else if (base_name == "resolution") {
+		ret.type = media_feature_type::resolution;
+		units = &resolution_units;
+	} else if (name == "orientation" && value == "portrait") {
+		ret.type = media_feature_type::portrait;
+		return ret;
+	} else if (name == "orientation" && value == "landscape") {
+		ret.type = media_feature_type::landscape;
+		return ret;
+	} else {
+		// discrete feature
+		ret.name = std::string(name).append(":").append(value);
+		return ret;
+	}
+
+	auto v = parse_dimension(text, value, *units, error);
+	if (!v.has_value()) {
+		return std::nullopt;
+	}
+
+	switch (r) {
+		case range::exact:
+			ret.min = v.value();
+			ret.max = v.value();
+			break;
+		case range::min:
+			ret.min = v.value();
+			break;
+		case range::max:
+			ret.max = v.value();
+			break;
+	}
+
+	return ret;
+}
+} // namespace
+
+namespace {
+std::optional<media_query> parse_media_query(std::string_view text, std::string_view str, std::string& error)
+{
+	media_query ret;
+
+	bool first = true;
+
+	for (auto i = str.begin(); i != str.end();) {
+		auto c = *i;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			++i;
+			continue;
+		}
+
+		if (c == '(') {
+			auto close = std::find(i, str.end(), ')');
+			if (close == str.end()) {
+				set_error(error, text, "closing parenthesis expected");
+				return std::nullopt;
+			}
+			auto e = parse_media_expression(
+				text, //
+				str.substr(size_t(std::distance(str.begin(), i)) + 1, size_t(std::distance(i, close)) - 1),
+				error
+			);
+			if (!e.has_value()) {
+				return std::nullopt;
+			}
+			ret.expressions.push_back(std::move(e.value()));
+			i = std::next(close);
+			first = false;
+			continue;
+		}
+
+		auto word_end = std::find_if(i, str.end(), [](char c) {
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '(';
+		});
+		auto word = str.substr(size_t(std::distance(str.begin(), i)), size_t(std::distance(i, word_end)));
+		i = word_end;
+
+		if (first && word == "not") {
+			ret.negated = true;
+		} else if (first && word == "only") {
+			// 'only' is for hiding the query from legacy user agents, has no effect
+		} else if (word == "and") {
+			if (first) {
+				set_error(error, text, "unexpected 'and'");
+				return std::nullopt;
+			}
+		} else if (word == "all") {
+			// matches all media types, no need to check anything
+		} else {
+			// media type
+			media_expression e;
+			e.name = std::string(word);
+			ret.expressions.push_back(std::move(e));
+		}
+
+		first = false;
+	}
+
+	if (first) {
+		set_error(error, text, "empty media query");
+		return std::nullopt;
+	}
+
+	return ret;
+}
+} // namespace
+
+std::optional<media_condition> cssom::parse_media_condition(std::string_view text, std::string& error)
+{
+	media_condition ret;
+	ret.text = std::string(utki::trim(text));
+
+	if (ret.text.empty()) {
+		return ret;
+	}
+
+	std::string_view str = ret.text;
+
+	for (size_t begin = 0; begin <= str.size();) {
+		auto end = str.find(',', begin);
+		if (end == std::string_view::npos) {
+			end = str.size();
+		}
+
+		auto q = parse_media_query(ret.text, str.substr(begin, end - begin), error);
+		if (!q.has_value()) {
+			return std::nullopt;
+		}
+		ret.queries.push_back(std::move(q.value()));
+
+		begin = end + 1;
+	}
+
+	return ret;
+}
+
+media_condition cssom::parse_media_condition(std::string_view text)
+{
+	std::string error;
+	auto ret = parse_media_condition(text, error);
+	if (!ret.has_value()) {
+		throw malformed_css_error(error);
+	}
+	return std::move(ret.value());
+}
+
+media_view::media_view(const sheet& s, const std::vector<bool>& active_blocks) :
+	source(s)
+{
+	ASSERT(active_blocks.size() == s.media_blocks.size())
+
+	this->styles.reserve(s.styles.size());
+	for (const auto& st : s.styles) {
+		this->styles.push_back(&st);
+	}
+
+	std::vector<const style*> merged;
+
+	for (size_t i = 0; i != s.media_blocks.size(); ++i) {
+		if (!active_blocks[i]) {
+			continue;
+		}
+
+		const auto& block_styles = s.media_blocks[i].styles;
+
+		merged.clear();
+		merged.reserve(this->styles.size() + block_styles.size());
+
+		// Among the styles of equal specificity the one which comes later in the source goes first.
+		// Property lists are added to the sheet's pool in the source order, so the later style is the one
+		// with greater property list index.
+		auto goes_first = [](const style& a, const style& b) {
+			if (a.specificity != b.specificity) {
+				return a.specificity > b.specificity;
+			}
+			return a.properties_index > b.properties_index;
+		};
+
+		auto j = block_styles.begin();
+		auto k = this->styles.begin();
+		while (j != block_styles.end() || k != this->styles.end()) {
+			if (k == this->styles.end() || (j != block_styles.end() && goes_first(*j, **k))) {
+				merged.push_back(&*j);
+				++j;
+			} else {
+				merged.push_back(*k);
+				++k;
+			}
+		}
+
+		std::swap(merged, this->styles);
+	}
+
+	for (auto st : this->styles) {
+		for (const auto& p : s.get_properties(*st)) {
+			this->styles_by_property[p.first].push_back(st);
+		}
+	}
+}
+
+sheet::query_result media_view::get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const
+{
+	CSSOM_INSTRUMENTATION_COUNT(queries);
+
+	auto i = this->styles_by_property.find(property_id);
+	if (i == this->styles_by_property.end()) {
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		return sheet::query_result{nullptr, 0};
+	}
+
+	for (auto st : i->second) {
+		CSSOM_INSTRUMENTATION_COUNT(rules_examined);
+		CSSOM_INSTRUMENTATION_COUNT(crawler_reset_calls);
+		crawler.reset();
+
+		if (st->is_matching(crawler)) {
+			CSSOM_INSTRUMENTATION_COUNT(matches);
+			const auto& props = this->source.get_properties(*st);
+			auto p = props.find(property_id);
+			ASSERT(p != props.end())
+			// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+			return sheet::query_result{p->second.get(), st->specificity};
+		}
+	}
+
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	return sheet::query_result{nullptr, 0};
+}
+
+size_t media_view::get_property_values(
+	xml_dom_crawler& crawler,
+	utki::span<const uint32_t> property_ids,
+	utki::span<sheet::query_result> out
+) const
+{
+	return detail::get_property_values(
+		this->styles, //
+		[this](const style& s) -> const property_list& {
+			return this->source.get_properties(s);
+		},
+		crawler,
+		property_ids,
+		out
+	);
+}
+
+media_sheet::media_sheet(sheet s) :
+	source(std::make_unique<const sheet>(std::move(s)))
+{}
+
+const media_view& media_sheet::get_view(const media_environment& env)
+{
+	ASSERT(this->source)
+
+	std::vector<bool> active_blocks;
+	active_blocks.reserve(this->source->media_blocks.size());
+	for (const auto& b : this->source->media_blocks) {
+		active_blocks.push_back(b.condition.is_active(env));
+	}
+
+	auto i = this->views.find(active_blocks);
+	if (i != this->views.end()) {
+		return i->second;
+	}
+
+	return this->views.try_emplace(active_blocks, *this->source, active_blocks).first->second;
+}
@@ -0,0 +1,154 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <utki/debug.hpp>
+
+#include "om.hpp"
+
+namespace cssom {
+
+/**
+ * @brief Flattened view of the styles of a sheet which are active in a particular media environment.
+ * The view contains the unconditional styles of the sheet and the styles of the active media blocks,
+ * merged by specificity. Among the styles of equal specificity the one which comes later in the source
+ * takes precedence, same as in CSS cascade. The source order is the order of the styles' property lists
+ * in the sheet::property_lists, which is the case for sheets made by cssom::read(), sheet::append()
+ * and sheet::insert_style().
+ * Styles of inactive media blocks are not present in the view at all.
+ * The view refers to the styles and property lists of the sheet, so the sheet must outlive the view
+ * and must not be modified.
+ */
+class media_view
+{
+	const sheet& source;
+
+	std::vector<const style*> styles;
+
+	// property id to styles defining the property, in the order of precedence
+	std::unordered_map<uint32_t, std::vector<const style*>> styles_by_property;
+
+public:
+	/**
+	 * @brief Create view.
+	 * @param s - sheet to make the view of. Must be sorted by specificity.
+	 * @param active_blocks - flags of active media blocks, one for each of sheet::media_blocks.
+	 */
+	media_view(const sheet& s, const std::vector<bool>& active_blocks);
+
+	/**
+	 * @brief Get styles of the view.
+	 * @return active styles in the order of precedence.
+	 */
+	utki::span<const style* const> get_styles() const noexcept
+	{
+		return this->styles;
+	}
+
+	/**
+	 * @brief Get property value for given xml document node.
+	 * Same as sheet::get_property_value(), but only the styles which define the property are matched.
+	 * @param crawler - crawler pointing to the node to get the property value for.
+	 * @param property_id - id of the property to get.
+	 * @return query result.
+	 */
+	sheet::query_result get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const;
+
+	/**
+	 * @brief Get values of several properties for given xml document node.
+	 * Same as sheet::get_property_values().
+	 * @param crawler - crawler pointing to the node to get the property values for.
+	 * @param property_ids - ids of the properties to get.
+	 * @param out - query results, one for each property id. Must have same size as property_ids.
+	 * @return number of resolved properties.
+	 */
+	size_t get_property_values(
+		xml_dom_crawler& crawler,
+		utki::span<const uint32_t> property_ids,
+		utki::span<sheet::query_result> out
+	) const;
+};
+
+/**
+ * @brief Style sheet with media blocks.
+ * Makes views of the sheet for media environments. The views are cached by the set of active media blocks,
+ * so switching between environments which activate the same media blocks reuses the same view.
+ * Not thread-safe, get_view() modifies the cache.
+ */
+class media_sheet
+{
+	// the sheet is kept on heap, so that it does not change its address when the media sheet is moved,
+	// because the cached views refer to it
+	std::unique_ptr<const sheet> source;
+
+	// active media block flags to view
+	std::map<std::vector<bool>, media_view> views;
+
+public:
+	/**
+	 * @brief Create media sheet.
+	 * @param s - sheet. Must be sorted by specificity.
+	 */
+	explicit media_sheet(sheet s);
+
+	/**
+	 * @brief Get the sheet the media sheet was made from.
+	 * @return the source sheet.
+	 */
+	const sheet& get_sheet() const noexcept
+	{
+		ASSERT(this->source)
+		return *this->source;
+	}
+
+	/**
+	 * @brief Get view for given media environment.
+	 * Evaluates conditions of the media blocks and returns the cached view for the set of active blocks,
+	 * the view is created if there is no such view in the cache yet.
+	 * @param env - media environment.
+	 * @return view of the active styles. Stays valid for the lifetime of the media sheet,
+	 *         including when the media sheet is moved to another object.
+	 */
+	const media_view& get_view(const media_environment& env);
+
+	/**
+	 * @brief Get number of cached views.
+	 * @return number of cached views.
+	 */
+	size_t get_num_cached_views() const noexcept
+	{
+		return this->views.size();
+	}
+};
+
+} // namespace cssom
@@ -0,0 +1,154 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#include "om.hpp"
+
+using namespace cssom;
+
+namespace {
+// heap memory of the string, zero if the string fits into the small string buffer
+size_t get_heap_size(const std::string& str) noexcept
+{
+	static const auto small_string_capacity = std::string().capacity();
+	if (str.capacity() <= small_string_capacity) {
+		return 0;
+	}
+	return str.capacity() + 1; // +1 for the terminating zero
+}
+} // namespace
+
+namespace {
+template <typename element_type>
+size_t get_heap_size(const std::vector<element_type>& v) noexcept
+{
+	return v.capacity() * sizeof(element_type);
+}
+} // namespace
+
+namespace {
+void account_styles(const std::vector<style>& styles, sheet::memory_usage_report& report)
+{
+	report.styles += get_heap_size(styles);
+
+	for (const auto& st : styles) {
+		report.selectors += get_heap_size(st.selectors);
+
+		for (const auto& sel : st.selectors) {
+			report.selector_strings += get_heap_size(sel.id);
+			report.selector_strings += get_heap_size(sel.tag);
+
+			report.selectors += get_heap_size(sel.classes);
+			for (const auto& c : sel.classes) {
+				report.selector_strings += get_heap_size(c);
+			}
+
+			report.selectors += get_heap_size(sel.attributes);
+			for (const auto& a : sel.attributes) {
+				report.selector_strings += get_heap_size(a.value);
+			}
+
+			report.selectors += get_heap_size(sel.pseudo_classes);
+			for (const auto& pc : sel.pseudo_classes) {
+				report.selector_strings += get_heap_size(pc.argument);
+			}
+		}
+	}
+}
+} // namespace
+
+sheet::memory_usage_report sheet::memory_usage(
+	const std::function<size_t(uint32_t, const property_value_holder&)>& value_size
+) const
+{
+	memory_usage_report report;
+
+	account_styles(this->styles, report);
+
+	report.styles += get_heap_size(this->media_blocks);
+	for (const auto& b : this->media_blocks) {
+		account_styles(b.styles, report);
+
+		report.media_conditions += get_heap_size(b.condition.text);
+		report.media_conditions += get_heap_size(b.condition.queries);
+		for (const auto& q : b.condition.queries) {
+			report.media_conditions += get_heap_size(q.expressions);
+			for (const auto& e : q.expressions) {
+				report.media_conditions += get_heap_size(e.name);
+			}
+		}
+	}
+
+	// number of styles referring to each property list
+	std::vector<size_t> ref_counts(this->property_lists.size(), 0);
+	auto count_refs = [&ref_counts](const std::vector<style>& styles) {
+		for (const auto& st : styles) {
+			ASSERT(st.properties_index < ref_counts.size())
+			++ref_counts[st.properties_index];
+		}
+	};
+	count_refs(this->styles);
+	for (const auto& b : this->media_blocks) {
+		count_refs(b.styles);
+	}
+
+	report.property_lists += get_heap_size(this->property_lists);
+	report.num_property_lists = this->property_lists.size();
+
+	for (size_t i = 0; i != this->property_lists.size(); ++i) {
+		const auto& props = this->property_lists[i];
+
+		size_t list_size = props.capacity() * sizeof(property_list::value_type);
+		report.property_lists += list_size;
+
+		for (const auto& p : props) {
+			++report.num_property_values;
+			if (p.second.is_inline()) {
+				++report.num_inline_property_values;
+			}
+			if (p.second && value_size) {
+				auto size = value_size(p.first, p.second);
+				report.property_values += size;
+				list_size += size;
+			}
+		}
+
+		switch (ref_counts[i]) {
+			case 0:
+				++report.num_unused_property_lists;
+				break;
+			case 1:
+				report.unique_property_lists += list_size;
+				break;
+			default:
+				++report.num_shared_property_lists;
+				report.shared_property_lists += list_size;
+				break;
+		}
+	}
+
+	return report;
+}
@@ -27,11 +27,24 @@ SOFTWARE.
 #include "om.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <system_error>
+#include <thread>
 
 #include <utki/string.hpp>
 #include <utki/util.hpp>
 
-#include "parser.hpp"
+#include "builder.hpp"
+#include "instrumentation.hpp"
+#include "query.hpp"
 
 #ifdef assert
 #	undef assert
@@ -58,18 +71,44 @@ combinator parse_combinator(const std::string& str)
 } // namespace
 
 namespace {
-std::string combinator_to_string(combinator c)
+std::optional<attribute_operation> parse_attribute_operation(const std::string& str)
 {
-	switch (c) {
-		case combinator::descendant:
-			return " ";
-		case combinator::child:
-			return " > ";
-		case combinator::next_sibling:
-			return " + ";
-		case combinator::subsequent_sibling:
-			return " ~ ";
-		case combinator::none:
+	if (str.empty()) {
+		return attribute_operation::exists;
+	} else if (str == "=") {
+		return attribute_operation::equals;
+	} else if (str == "~=") {
+		return attribute_operation::includes;
+	} else if (str == "|=") {
+		return attribute_operation::dash_match;
+	} else if (str == "^=") {
+		return attribute_operation::prefix;
+	} else if (str == "$=") {
+		return attribute_operation::suffix;
+	} else if (str == "*=") {
+		return attribute_operation::substring;
+	}
+	return std::nullopt;
+}
+} // namespace
+
+namespace {
+std::string_view attribute_operation_to_string(attribute_operation op)
+{
+	switch (op) {
+		case attribute_operation::equals:
+			return "=";
+		case attribute_operation::includes:
+			return "~=";
+		case attribute_operation::dash_match:
+			return "|=";
+		case attribute_operation::prefix:
+			return "^=";
+		case attribute_operation::suffix:
+			return "$=";
+		case attribute_operation::substring:
+			return "*=";
+		case attribute_operation::exists:
 		default:
 			return "";
 	}
@@ -77,120 +116,127 @@ std::string combinator_to_string(combinator c)
 } // namespace
 
 namespace {
-class om_parser : public parser
+// parses the 'an+b' argument of the :nth-child() pseudo-class, returns nullopt if the argument is malformed
+std::optional<std::pair<int, int>> parse_nth(std::string_view str)
 {
-	selector cur_selector;
-	selector_chain cur_selector_chain;
-	std::shared_ptr<property_list> cur_property_list;
-	std::string cur_property_name;
-
-public:
-	sheet doc;
-
-	std::function<uint32_t(std::string_view)> property_name_to_id;
-	std::function<std::unique_ptr<cssom::property_value_base>(uint32_t, std::string_view)> parse_property;
-
-	om_parser(
-		std::function<uint32_t(std::string_view)> property_name_to_id,
-		std::function<std::unique_ptr<cssom::property_value_base>(uint32_t, std::string_view)> parse_property
-	) :
-		property_name_to_id(std::move(property_name_to_id)),
-		parse_property(std::move(parse_property))
-	{}
+	if (str == "odd") {
+		return std::make_pair(2, 1);
+	} else if (str == "even") {
+		return std::make_pair(2, 0);
+	}
 
-	void on_selector_chain_end() override
-	{
-		// TRACE(<< "selector chain END" << std::endl)
-		if (!this->cur_property_list) {
-			this->cur_property_list = std::make_shared<property_list>();
+	auto parse_int = [](std::string_view& s) -> std::optional<int> {
+		if (s.empty() || s.front() < '0' || s.front() > '9') {
+			return std::nullopt;
 		}
-		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
-		style s{
-			std::move(cur_selector_chain),
-			cur_property_list // several selectors may refer the same property list, therefore not moving
-		};
-		s.update_specificity();
-		doc.styles.emplace_back(std::move(s));
-		ASSERT(this->cur_selector_chain.empty())
-		ASSERT(this->cur_selector.classes.empty())
-		ASSERT(this->cur_selector.tag.empty())
-		// TODO: add assert(attributes of current selector are empty)
-	}
-
-	void on_selector_end() override
-	{
-		// TRACE(<< "selector END" << std::endl)
-		this->cur_selector_chain.push_back(std::move(this->cur_selector));
-	}
+		int ret = 0;
+		for (; !s.empty() && s.front() >= '0' && s.front() <= '9'; s.remove_prefix(1)) {
+			constexpr auto base = 10;
+			int digit = s.front() - '0';
+			if (ret > (std::numeric_limits<int>::max() - digit) / base) {
+				// too big number
+				return std::nullopt;
+			}
+			ret = ret * base + digit;
+		}
+		return ret;
+	};
 
-	void on_selector_tag(std::string str) override
-	{
-		// TRACE(<< "selector tag: " << str << std::endl)
-		this->cur_selector.tag = std::move(str);
-	}
+	auto s = str;
 
-	void on_selector_id(std::string str) override
-	{
-		// TRACE(<< "selector id: " << str << std::endl)
-		this->cur_selector.id = std::move(str);
+	int sign = 1;
+	if (!s.empty() && (s.front() == '+' || s.front() == '-')) {
+		sign = s.front() == '-' ? -1 : 1;
+		s.remove_prefix(1);
 	}
 
-	void on_selector_class(std::string str) override
-	{
-		// TRACE(<< "selector class: " << str << std::endl)
-		this->cur_selector.classes.push_back(std::move(str));
+	auto n_pos = s.find('n');
+	if (n_pos == std::string_view::npos) {
+		// just 'b'
+		auto b = parse_int(s);
+		if (!b.has_value() || !s.empty()) {
+			return std::nullopt;
+		}
+		return std::make_pair(0, sign * b.value());
 	}
 
-	void on_combinator(std::string str) override
-	{
-		// TRACE(<< "combinator: " << str << std::endl)
-		ASSERT(this->cur_selector.classes.empty())
-		ASSERT(this->cur_selector.tag.empty())
-		// TODO: add assert attributes of current selector are empty
-		ASSERT(!this->cur_selector_chain.empty())
-		this->cur_selector_chain.back().combinator = ::parse_combinator(str);
+	int a = 1;
+	if (n_pos != 0) {
+		auto a_str = s.substr(0, n_pos);
+		auto parsed_a = parse_int(a_str);
+		if (!parsed_a.has_value() || !a_str.empty()) {
+			return std::nullopt;
+		}
+		a = parsed_a.value();
 	}
+	a *= sign;
 
-	void on_style_properties_end() override
-	{
-		// TRACE(<< "style properties END" << std::endl)
-		this->cur_property_list.reset();
+	s = utki::trim_front(s.substr(n_pos + 1));
+	if (s.empty()) {
+		return std::make_pair(a, 0);
 	}
 
-	void on_property_name(std::string str) override
-	{
-		// TRACE(<< "property name: " << str << std::endl)
-		ASSERT(this->cur_property_list)
-		this->cur_property_name = std::move(str);
+	if (s.front() != '+' && s.front() != '-') {
+		return std::nullopt;
 	}
+	sign = s.front() == '-' ? -1 : 1;
+	s = utki::trim_front(s.substr(1));
 
-	void on_property_value(std::string str) override
-	{
-		// TRACE(<< "property value: " << str << std::endl)
+	auto b = parse_int(s);
+	if (!b.has_value() || !s.empty()) {
+		return std::nullopt;
+	}
 
-		ASSERT(!this->cur_property_name.empty())
+	return std::make_pair(a, sign * b.value());
+}
+} // namespace
 
-		ASSERT(this->property_name_to_id)
-		uint32_t id = this->property_name_to_id(this->cur_property_name);
+namespace {
+void sort_by_specificity(std::vector<style>& styles)
+{
+	std::stable_sort(
+		styles.begin(), //
+		styles.end(),
+		[](const auto& a, const auto& b) -> bool {
+			return a.specificity > b.specificity; // descending order
+		}
+	);
+}
+} // namespace
 
-		ASSERT(this->parse_property)
-		auto value = this->parse_property(id, std::move(str));
+namespace {
+// Merges sorted newer styles into sorted styles,
+// the newer styles take precedence over the styles of equal specificity.
+void merge_styles(std::vector<style>& styles, std::vector<style> newer)
+{
+	if (newer.empty()) {
+		return;
+	}
 
-		if (!value) {
-			// could not parse style property value, ignore
-			return;
+	std::vector<style> merged;
+	merged.reserve(styles.size() + newer.size());
+
+	// std::merge() takes the element from the first range when elements are equivalent,
+	// so newer styles go before the styles of equal specificity.
+	std::merge(
+		std::make_move_iterator(newer.begin()), //
+		std::make_move_iterator(newer.end()),
+		std::make_move_iterator(styles.begin()),
+		std::make_move_iterator(styles.end()),
+		std::back_inserter(merged),
+		[](const auto& a, const auto& b) {
+			return a.specificity > b.specificity; // descending order
 		}
+	);
 
-		ASSERT(this->cur_property_list)
-		(*this->cur_property_list)[id] = std::move(value);
-	}
-};
+	styles = std::move(merged);
+}
 } // namespace
 
-sheet cssom::read(
-	const fsif::file& fi,
-	std::function<uint32_t(std::string_view)> property_name_to_id,
-	std::function<std::unique_ptr<cssom::property_value_base>(uint32_t, std::string_view)> parse_property
+namespace {
+void check_read_arguments(
+	const std::function<uint32_t(std::string_view)>& property_name_to_id,
+	const std::function<property_value_holder(uint32_t, std::string_view)>& parse_property
 )
 {
 	if (!property_name_to_id) {
@@ -199,309 +245,1266 @@ sheet cssom::read(
 	if (!parse_property) {
 		throw std::logic_error("cssom::read(): passed in 'parse_property' function is nullptr");
 	}
+}
+} // namespace
+
+sheet_builder::sheet_builder(
+	std::function<uint32_t(std::string_view)> property_name_to_id,
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property_value
+) :
+	property_name_to_id(std::move(property_name_to_id)),
+	parse_property(std::move(parse_property_value))
+{
+	check_read_arguments(this->property_name_to_id, this->parse_property);
+}
+
+void sheet_builder::on_selector_chain_end()
+{
+	// TRACE(<< "selector chain END" << std::endl)
+	if (!this->cur_property_list.has_value()) {
+		this->cur_property_list = this->doc.add_property_list(property_list());
+	}
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	style s{
+		std::move(cur_selector_chain),
+		this->cur_property_list.value() // several selectors may refer the same property list
+	};
+	s.update_specificity();
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	this->pending.push_back(pending_style{std::move(s), this->cur_media_block});
+	ASSERT(this->cur_selector_chain.empty())
+	ASSERT(this->cur_selector.classes.empty())
+	ASSERT(this->cur_selector.tag.empty())
+	ASSERT(this->cur_selector.attributes.empty())
+	ASSERT(this->cur_selector.pseudo_classes.empty())
+}
 
-	om_parser p(std::move(property_name_to_id), std::move(parse_property));
+void sheet_builder::on_selector_end()
+{
+	// TRACE(<< "selector END" << std::endl)
+	this->cur_selector_chain.push_back(std::move(this->cur_selector));
+}
 
-	{
-		fsif::file::guard file_guard(fi);
+void sheet_builder::on_selector_tag(std::string str)
+{
+	// TRACE(<< "selector tag: " << str << std::endl)
+	this->cur_selector.tag = std::move(str);
+}
+
+void sheet_builder::on_selector_id(std::string str)
+{
+	// TRACE(<< "selector id: " << str << std::endl)
+	this->cur_selector.id = std::move(str);
+}
 
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
-		std::array<uint8_t, size_t(utki::kilobyte) * 4> buf;
+void sheet_builder::on_selector_class(std::string str)
+{
+	// TRACE(<< "selector class: " << str << std::endl)
+	this->cur_selector.classes.push_back(std::move(str));
+}
 
-		while (true) {
-			auto res = fi.read(utki::make_span(buf));
-			utki::assert(res <= buf.size(), SL);
-			if (res == 0) {
-				break;
-			}
-			p.feed(utki::make_span(buf.data(), res));
+void sheet_builder::on_selector_attribute(std::string name, std::string operation, std::string value)
+{
+	// TRACE(<< "selector attribute: " << name << operation << value << std::endl)
+	auto op = ::parse_attribute_operation(operation);
+	if (!op.has_value()) {
+		std::stringstream ss;
+		ss << "unknown attribute selector operation: " << operation;
+		this->fail(ss.str());
+		return;
+	}
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	this->cur_selector.attributes.push_back(attribute_selector{
+		intern(name), //
+		op.value(),
+		std::move(value)
+	});
+}
+
+void sheet_builder::on_selector_pseudo_class(std::string name, std::string argument)
+{
+	// TRACE(<< "selector pseudo-class: " << name << "(" << argument << ")" << std::endl)
+	pseudo_class pc;
+	pc.name = intern(name);
+
+	if (argument.empty()) {
+		if (name == "first-child") {
+			pc.type = pseudo_class_type::first_child;
+		} else if (name == "last-child") {
+			pc.type = pseudo_class_type::last_child;
+		} else if (name == "only-child") {
+			pc.type = pseudo_class_type::only_child;
+		}
+	} else if (name == "nth-child") {
+		pc.type = pseudo_class_type::nth_child;
+		auto nth = ::parse_nth(argument);
+		if (!nth.has_value()) {
+			std::stringstream ss;
+			ss << "malformed :nth-child() argument: " << argument;
+			this->fail(ss.str());
+			return;
 		}
+		std::tie(pc.a, pc.b) = nth.value();
 	}
 
-	p.doc.sort_styles_by_specificity();
+	pc.argument = std::move(argument);
 
-	return std::move(p.doc);
+	this->cur_selector.pseudo_classes.push_back(std::move(pc));
 }
 
-namespace {
-const auto comma = utki::make_span(", ");
-const auto period = utki::make_span(".");
-const auto hash_sign = utki::make_span("#");
-const auto open_curly_brace = utki::make_span(" {\n");
-const auto tab_char = utki::make_span("\t");
-const auto new_line_char = utki::make_span("\n");
-const auto close_curly_brace = utki::make_span("}\n");
-const auto semicolon = utki::make_span("; ");
-const auto colon = utki::make_span(": ");
-} // namespace
+void sheet_builder::on_combinator(std::string str)
+{
+	// TRACE(<< "combinator: " << str << std::endl)
+	ASSERT(this->cur_selector.classes.empty())
+	ASSERT(this->cur_selector.tag.empty())
+	ASSERT(this->cur_selector.attributes.empty())
+	ASSERT(this->cur_selector.pseudo_classes.empty())
+	ASSERT(!this->cur_selector_chain.empty())
+	this->cur_selector_chain.back().combinator = ::parse_combinator(str);
+}
 
-namespace {
-std::string get_name(const style& st)
+void sheet_builder::on_style_properties_end()
 {
-	std::stringstream ss;
+	// TRACE(<< "style properties END" << std::endl)
+	this->cur_property_list.reset();
+	this->num_complete = this->pending.size();
+}
 
-	for (const auto& s : st.selectors) {
-		ss << s.tag;
+void sheet_builder::on_property_name(std::string str)
+{
+	// TRACE(<< "property name: " << str << std::endl)
+	ASSERT(this->cur_property_list.has_value())
+	this->cur_property_name = std::move(str);
+}
 
-		if (!s.id.empty()) {
-			ss << hash_sign << s.id;
-		}
+void sheet_builder::on_property_value(std::string str)
+{
+	// TRACE(<< "property value: " << str << std::endl)
 
-		for (auto& c : s.classes) {
-			ss << period << c;
-		}
+	ASSERT(!this->cur_property_name.empty())
 
-		// TODO: selector attributes
+	ASSERT(this->property_name_to_id)
+	uint32_t id = this->property_name_to_id(this->cur_property_name);
 
-		ss << combinator_to_string(s.combinator);
+	ASSERT(this->parse_property)
+	auto value = this->parse_property(id, std::move(str));
+
+	if (!value) {
+		// could not parse style property value, ignore
+		return;
 	}
-	return ss.str();
+
+	ASSERT(this->cur_property_list.has_value())
+	this->doc.property_lists[this->cur_property_list.value()][id] = std::move(value);
 }
-} // namespace
 
-namespace {
-std::string to_string(
-	const property_list& prop_list,
-	const std::function<std::string(uint32_t)>& property_id_to_name,
-	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string
-)
+void sheet_builder::on_media_begin(std::string condition)
 {
-	std::stringstream ss;
-	for (auto& prop : prop_list) {
-		auto name = property_id_to_name(prop.first);
-
-		if (name.empty()) {
-			continue;
-		}
+	// TRACE(<< "media: " << condition << std::endl)
+	if (this->cur_property_list.has_value()) {
+		this->fail("unexpected @media inside of selector group");
+		return;
+	}
 
-		ss << name << colon;
-		auto value = property_value_to_string(prop.first, *prop.second);
-		ss << value << semicolon;
+	std::string error;
+	auto cond = parse_media_condition(condition, error);
+	if (!cond.has_value()) {
+		this->fail(error);
+		return;
 	}
 
-	return ss.str();
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	this->doc.media_blocks.push_back(media_block{std::move(cond.value()), {}});
+	this->cur_media_block = this->doc.media_blocks.size() - 1;
 }
-} // namespace
 
-namespace {
-// Produces deterministic list of CSS rules.
-// The list is sorted by property groups and within a group is sorted by rule "name".
-std::vector<std::pair<std::string, std::shared_ptr<std::string>>> to_string_styles(
-	utki::span<const style> styles, //
-	const std::function<std::string(uint32_t)>& property_id_to_name,
-	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string
-)
+void sheet_builder::on_media_end()
 {
-	std::map<property_list*, std::shared_ptr<std::string>> props_map;
+	// TRACE(<< "media END" << std::endl)
+	this->cur_media_block.reset();
+}
 
-	std::vector<std::pair<std::string, std::shared_ptr<std::string>>> str_styles;
+void sheet_builder::on_error(const parse_error& error)
+{
+	// discard the malformed rule
+	this->cur_selector = selector();
+	this->cur_selector_chain.clear();
+	this->cur_property_name.clear();
+
+	this->pending.erase(
+		std::next(this->pending.begin(), std::ptrdiff_t(this->num_complete)), //
+		this->pending.end()
+	);
 
-	for (const auto& s : styles) {
-		auto props_ptr = s.properties.get();
-		ASSERT(props_ptr)
-		auto props_iter = props_map.find(props_ptr);
-		if (props_iter == props_map.end()) {
-			auto res = props_map.insert(std::make_pair(
-				props_ptr,
-				std::make_shared<std::string>(to_string(
-					*s.properties, //
-					property_id_to_name,
-					property_value_to_string
-				))
-			));
-			ASSERT(res.second)
-			props_iter = res.first;
-		}
-		ASSERT(props_iter != props_map.end())
-
-		str_styles.emplace_back(
-			get_name(s), //
-			props_iter->second
-		);
+	if (this->cur_property_list.has_value()) {
+		// the property list of the current rule is always the last one in the pool
+		ASSERT(this->cur_property_list.value() == this->doc.property_lists.size() - 1)
+		this->doc.property_lists.pop_back();
+		this->cur_property_list.reset();
 	}
 
-	std::sort(
-		str_styles.begin(), //
-		str_styles.end(),
-		[](const auto& a, const auto& b) {
-			// sort by property_list to make consequent gropus using same property list by name within group
-			if (*a.second < *b.second) {
-				return true;
-			} else if (*a.second > *b.second) {
-				return false;
-			}
+	this->errors.push_back(error);
+}
 
-			// sort by name within the group
-			return a.first < b.first;
-		}
+void sheet_builder::publish()
+{
+	if (this->num_complete == 0) {
+		return;
+	}
+
+	// completed styles by target, index 0 is for the unconditional styles, i + 1 is for the media block i
+	std::vector<std::vector<style>> completed(this->doc.media_blocks.size() + 1);
+
+	// later rules in the source take precedence over earlier rules of equal specificity, so go in reverse order
+	for (size_t i = this->num_complete; i != 0; --i) {
+		auto& p = this->pending[i - 1];
+		auto target = p.media_block.has_value() ? p.media_block.value() + 1 : 0;
+		completed[target].push_back(std::move(p.s));
+	}
+
+	this->pending.erase(
+		this->pending.begin(), //
+		std::next(this->pending.begin(), std::ptrdiff_t(this->num_complete))
 	);
+	this->num_complete = 0;
+
+	for (size_t i = 0; i != completed.size(); ++i) {
+		auto& styles = completed[i];
+		sort_by_specificity(styles);
+		merge_styles(
+			i == 0 ? this->doc.styles : this->doc.media_blocks[i - 1].styles, //
+			std::move(styles)
+		);
+	}
+}
 
-	return str_styles;
+const sheet& sheet_builder::get_sheet()
+{
+	this->publish();
+	return this->doc;
 }
-} // namespace
 
-void sheet::write(
-	fsif::file& fi,
-	const std::function<std::string(uint32_t)>& property_id_to_name,
-	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
-	std::string_view indent
-) const
+sheet sheet_builder::build()
 {
-	auto styles_to_save = to_string_styles(
-		this->styles, //
-		property_id_to_name,
-		property_value_to_string
-	);
+	// end of data closes the incomplete trailing rule, if any
+	this->num_complete = this->pending.size();
+	this->cur_property_list.reset();
 
-	fsif::file::guard file_guard(fi, fsif::mode::create);
+	this->publish();
 
-	for (auto i = styles_to_save.begin(); i != styles_to_save.end(); ++i) {
-		// Go through selector chains which refer to the same property set (selectors in the same selector group).
-		// These are selector chains specified as comma separated list before defining their properties in CSS sheet,
-		// such selector chains will go in a row.
-		auto selector_group_start_iter = i;
-		for (auto j = selector_group_start_iter; j != styles_to_save.end(); ++j) {
-			if (j->second.get() != selector_group_start_iter->second.get()) {
-				ASSERT(j > i)
-				i = --j;
-				break;
-			}
+	return std::move(this->doc);
+}
 
-			i = j;
+namespace {
+// feeds whole file to the parser
+void parse_file(const fsif::file& fi, parser& p)
+{
+	fsif::file::guard file_guard(fi);
 
-			if (j != selector_group_start_iter) {
-				fi.write(comma);
-			} else {
-				fi.write(utki::make_span(indent));
-			}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
+	std::array<uint8_t, size_t(utki::kilobyte) * 4> buf;
 
-			fi.write(j->first);
+	while (true) {
+		auto res = fi.read(utki::make_span(buf));
+		utki::assert(res <= buf.size(), SL);
+		if (res == 0) {
+			break;
 		}
+		p.feed(utki::make_span(buf.data(), res));
+	}
+}
+} // namespace
 
-		// write properties
-		fi.write(open_curly_brace);
-		fi.write(utki::make_span(indent));
-		fi.write(tab_char);
-
-		ASSERT(selector_group_start_iter->second)
+sheet cssom::read(
+	const fsif::file& fi,
+	std::function<uint32_t(std::string_view)> property_name_to_id,
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property
+)
+{
+	sheet_builder b(std::move(property_name_to_id), std::move(parse_property));
 
-		fi.write(*selector_group_start_iter->second);
+	parse_file(fi, b);
 
-		fi.write(new_line_char);
-		fi.write(utki::make_span(indent));
-		fi.write(close_curly_brace);
-	}
+	return b.build();
 }
 
-void sheet::sort_styles_by_specificity()
+sheet cssom::read(
+	const fsif::file& fi,
+	std::function<uint32_t(std::string_view)> property_name_to_id,
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property,
+	std::vector<parse_error>& errors
+)
 {
-	std::sort(
-		this->styles.begin(), //
-		this->styles.end(),
-		[](const auto& a, const auto& b) -> bool {
-			return a.specificity > b.specificity; // descending order
-		}
-	);
+	sheet_builder b(std::move(property_name_to_id), std::move(parse_property));
+	b.set_error_recovery(true);
+
+	parse_file(fi, b);
+
+	auto ret = b.build();
+
+	errors = std::move(b).get_errors();
+
+	return ret;
 }
 
-void style::update_specificity() noexcept
+sheet cssom::read(
+	utki::span<const fsif::file* const> files,
+	const std::function<uint32_t(std::string_view)>& property_name_to_id,
+	const std::function<property_value_holder(uint32_t, std::string_view)>& parse_property,
+	unsigned num_threads
+)
 {
-	// According to CSS spec (https://www.w3.org/TR/2018/CR-selectors-3-20180130/#specificity) we need to:
-	// - count the number of ID selectors in the selector (= a)
-	// - count the number of class selectors, attributes selectors, and pseudo-classes in the selector (= b)
-	// - count the number of type selectors and pseudo-elements in the selector (= c)
-	// - ignore the universal selector
-	// and then concatenate the three numbers 'abc' (in a number system with a large base) to get the overall selector
-	// chain specificity.
-
-	unsigned num_ids = 0;
-	unsigned num_classes = 0;
-	unsigned num_types = 0;
-	for (auto& s : this->selectors) {
-		if (!s.id.empty()) {
-			++num_ids;
-		}
-		if (!s.tag.empty()) {
-			if (s.tag.back() != '*') { // if not a universal selector
-				++num_types;
+	check_read_arguments(property_name_to_id, parse_property);
+
+	// sheets of the files, each one is sorted by specificity
+	std::vector<sheet> sheets(files.size());
+	std::vector<std::exception_ptr> errors(files.size());
+
+	std::atomic<size_t> next_file = 0;
+
+	auto work = [&]() {
+		for (size_t i = next_file++; i < files.size(); i = next_file++) {
+			try {
+				ASSERT(files[i])
+				sheet_builder b(property_name_to_id, parse_property);
+				parse_file(*files[i], b);
+				sheets[i] = b.build();
+			} catch (...) {
+				errors[i] = std::current_exception();
 			}
-			// TODO: add pseudo-elements to num_types
 		}
-		num_classes += unsigned(s.classes.size());
-		// TODO: add num attributes and pseudo-classes to num_classes
+	};
+
+	if (num_threads == 0) {
+		num_threads = std::max(std::thread::hardware_concurrency(), 1u);
 	}
+	num_threads = unsigned(std::min(size_t(num_threads), files.size()));
 
-	using std::min;
+	{
+		// the calling thread is one of the workers
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < num_threads; ++i) {
+			try {
+				threads.emplace_back(work);
+			} catch (const std::system_error&) {
+				// could not start more threads, do with the ones already started
+				break;
+			}
+		}
 
-	unsigned max_val = utki::byte_mask;
-	this->specificity = (uint32_t(min(max_val, num_ids)) << (utki::byte_bits * 2)) | //
-		(uint32_t(min(max_val, num_classes)) << utki::byte_bits) | //
-		uint32_t(min(max_val, num_types));
-}
+		work();
 
-bool selector::is_matching(const styleable& node) const
-{
-	if (!this->tag.empty() && this->tag.back() != '*') {
-		if (this->tag != node.get_tag()) {
-			return false;
+		for (auto& t : threads) {
+			t.join();
 		}
 	}
 
-	if (!this->id.empty()) {
-		if (this->id != node.get_id()) {
-			return false;
+	for (const auto& e : errors) {
+		if (e) {
+			std::rethrow_exception(e);
 		}
 	}
 
-	auto nc = node.get_classes();
-	for (auto& cls : this->classes) {
-		if (std::find(nc.begin(), nc.end(), cls) == nc.end()) {
-			return false;
-		}
+	sheet ret;
+
+	size_t num_styles = 0;
+	size_t num_property_lists = 0;
+	for (const auto& s : sheets) {
+		num_styles += s.styles.size();
+		num_property_lists += s.property_lists.size();
 	}
+	ret.styles.reserve(num_styles);
+	ret.property_lists.reserve(num_property_lists);
 
-	// TODO: attribute selectors
+	for (auto& s : sheets) {
+		auto offset = ret.property_lists.size();
+		std::move(s.property_lists.begin(), s.property_lists.end(), std::back_inserter(ret.property_lists));
 
-	return true;
-}
+		for (auto& st : s.styles) {
+			st.properties_index += offset;
+		}
 
-namespace {
-bool is_descendant_matching(xml_dom_crawler& crawler, const selector& sel)
-{
-	while (crawler.move_up()) {
-		if (sel.is_matching(crawler.get())) {
-			return true;
+		for (auto& b : s.media_blocks) {
+			for (auto& st : b.styles) {
+				st.properties_index += offset;
+			}
+			ret.media_blocks.push_back(std::move(b));
 		}
 	}
-	return false;
-}
-} // namespace
 
-namespace {
-bool is_child_matching(xml_dom_crawler& crawler, const selector& sel)
-{
-	if (!crawler.move_up()) {
-		return false;
+	// Each sheet is sorted already. Concatenate those in reverse order, so that styles of later files go first,
+	// then a single stable sort puts styles of equal specificity in the right order.
+	for (auto i = sheets.rbegin(); i != sheets.rend(); ++i) {
+		std::move(i->styles.begin(), i->styles.end(), std::back_inserter(ret.styles));
 	}
-	return sel.is_matching(crawler.get());
+	ret.sort_styles_by_specificity();
+
+	return ret;
+}
+
+namespace {
+constexpr std::string_view comma = ", ";
+constexpr std::string_view minified_comma = ",";
+constexpr std::string_view period = ".";
+constexpr std::string_view hash_sign = "#";
+constexpr std::string_view open_square_bracket = "[";
+constexpr std::string_view close_square_bracket = "]";
+constexpr std::string_view double_quote = "\"";
+constexpr std::string_view single_quote = "'";
+constexpr std::string_view colon_char = ":";
+constexpr std::string_view open_paren = "(";
+constexpr std::string_view close_paren = ")";
+constexpr std::string_view open_curly_brace = " {\n";
+constexpr std::string_view minified_open_curly_brace = "{";
+constexpr std::string_view tab_char = "\t";
+constexpr std::string_view new_line_char = "\n";
+constexpr std::string_view close_curly_brace = "}\n";
+constexpr std::string_view minified_close_curly_brace = "}";
+constexpr std::string_view semicolon = "; ";
+constexpr std::string_view minified_semicolon = ";";
+constexpr std::string_view colon = ": ";
+constexpr std::string_view media_keyword = "@media ";
+} // namespace
+
+namespace {
+std::string_view combinator_to_string(combinator c, bool minify)
+{
+	switch (c) {
+		case combinator::descendant:
+			return " ";
+		case combinator::child:
+			return minify ? ">" : " > ";
+		case combinator::next_sibling:
+			return minify ? "+" : " + ";
+		case combinator::subsequent_sibling:
+			return minify ? "~" : " ~ ";
+		case combinator::none:
+		default:
+			return "";
+	}
+}
+} // namespace
+
+namespace {
+void append_name(std::string& out, const style& st, bool minify)
+{
+	for (const auto& s : st.selectors) {
+		out.append(s.tag);
+
+		if (!s.id.empty()) {
+			out.append(hash_sign).append(s.id);
+		}
+
+		for (auto& c : s.classes) {
+			out.append(period).append(c);
+		}
+
+		for (const auto& a : s.attributes) {
+			out.append(open_square_bracket).append(a.name);
+			if (a.operation != attribute_operation::exists) {
+				auto quote = a.value.find('"') == std::string::npos ? double_quote : single_quote;
+				out.append(attribute_operation_to_string(a.operation)).append(quote).append(a.value).append(quote);
+			}
+			out.append(close_square_bracket);
+		}
+
+		for (const auto& pc : s.pseudo_classes) {
+			out.append(colon_char).append(pc.name);
+			if (!pc.argument.empty()) {
+				out.append(open_paren).append(pc.argument).append(close_paren);
+			}
+		}
+
+		out.append(combinator_to_string(s.combinator, minify));
+	}
+}
+} // namespace
+
+namespace {
+void append_properties(
+	std::string& out,
+	const property_list& prop_list,
+	const std::function<std::string(uint32_t)>& property_id_to_name,
+	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+	bool minify
+)
+{
+	bool first = true;
+	for (auto& prop : prop_list) {
+		auto name = property_id_to_name(prop.first);
+
+		if (name.empty()) {
+			continue;
+		}
+
+		if (minify) {
+			// no semicolon after the last property
+			if (!first) {
+				out.append(minified_semicolon);
+			}
+			out.append(name).append(colon_char).append(property_value_to_string(prop.first, *prop.second));
+		} else {
+			out.append(name).append(colon).append(property_value_to_string(prop.first, *prop.second)).append(semicolon);
+		}
+
+		first = false;
+	}
+}
+} // namespace
+
+namespace {
+// Accumulates output in a buffer and writes it to the file in large blocks.
+class buffered_writer
+{
+	fsif::file& fi;
+	std::string buf;
+
+	constexpr static auto flush_threshold = size_t(utki::kilobyte) * 64;
+
+public:
+	buffered_writer(fsif::file& fi) :
+		fi(fi)
+	{
+		this->buf.reserve(flush_threshold);
+	}
+
+	std::string& get_buffer() noexcept
+	{
+		return this->buf;
+	}
+
+	void write(std::string_view str)
+	{
+		this->buf.append(str);
+	}
+
+	// to be called after each rule, so that buffer does not grow too much
+	void flush_if_needed()
+	{
+		if (this->buf.size() >= flush_threshold) {
+			this->flush();
+		}
+	}
+
+	void flush()
+	{
+		if (this->buf.empty()) {
+			return;
+		}
+		this->fi.write(utki::make_span(this->buf));
+		this->buf.clear();
+	}
+};
+} // namespace
+
+namespace {
+// A range of characters within a string.
+struct string_range {
+	size_t begin;
+	size_t end;
+
+	std::string_view get(const std::string& str) const noexcept
+	{
+		return std::string_view(str).substr(this->begin, this->end - this->begin);
+	}
+};
+} // namespace
+
+namespace {
+// Selector group is the list of selector chains which refer to the same property list.
+// These are selector chains specified as comma separated list before defining their properties in CSS sheet.
+struct selector_group {
+	size_t properties_index;
+	std::vector<const style*> styles;
+};
+} // namespace
+
+namespace {
+// Groups styles by property lists, the groups are ordered so that reading the written groups back
+// gives the same precedence of the styles.
+// Among the styles of equal specificity the ones going first in the sheet take precedence, i.e. those
+// which come later in the source. So, within each run of equal specificity the styles are taken in reverse order,
+// which is the source order, and each group goes after the groups whose styles precede its styles in that order.
+// Among the groups not constrained by each other the one which occurs first in the sheet goes first.
+std::vector<selector_group> make_selector_groups(utki::span<const style> styles, size_t num_property_lists)
+{
+	constexpr auto no_group = std::numeric_limits<size_t>::max();
+
+	std::vector<selector_group> groups;
+
+	// property list index to group index
+	std::vector<size_t> group_indices(num_property_lists, no_group);
+
+	// group index of each style, in the source order
+	std::vector<size_t> style_groups;
+	style_groups.reserve(styles.size());
+
+	// groups which have to go after the group, may contain duplicates
+	std::vector<std::vector<size_t>> successors;
+
+	// number of groups which have to go before the group
+	std::vector<size_t> num_predecessors;
+
+	for (auto i = styles.begin(); i != styles.end();) {
+		auto run_begin = i;
+		for (; i != styles.end() && i->specificity == run_begin->specificity; ++i) {
+		}
+
+		std::optional<size_t> prev_group;
+
+		for (auto j = i; j != run_begin;) {
+			--j;
+			const auto& s = *j;
+
+			ASSERT(s.properties_index < num_property_lists)
+
+			auto& group_index = group_indices[s.properties_index];
+			if (group_index == no_group) {
+				group_index = groups.size();
+				// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+				groups.push_back(selector_group{s.properties_index, {}});
+				successors.emplace_back();
+				num_predecessors.push_back(0);
+			}
+
+			groups[group_index].styles.push_back(&s);
+
+			if (prev_group.has_value() && prev_group.value() != group_index) {
+				successors[prev_group.value()].push_back(group_index);
+				++num_predecessors[group_index];
+			}
+			prev_group = group_index;
+		}
+	}
+
+	// topological sort of the groups
+	std::vector<selector_group> ret;
+	ret.reserve(groups.size());
+
+	std::vector<bool> done(groups.size(), false);
+	std::priority_queue<size_t, std::vector<size_t>, std::greater<>> ready;
+	for (size_t g = 0; g != groups.size(); ++g) {
+		if (num_predecessors[g] == 0) {
+			ready.push(g);
+		}
+	}
+
+	// first group which is not done yet
+	size_t first_not_done = 0;
+
+	while (ret.size() != groups.size()) {
+		if (ready.empty()) {
+			// Styles of some groups interleave in the source order, so the precedence cannot be kept
+			// without splitting the groups. Take the first remaining group.
+			for (; done[first_not_done]; ++first_not_done) {
+			}
+			ready.push(first_not_done);
+		}
+
+		auto g = ready.top();
+		ready.pop();
+		if (done[g]) {
+			continue;
+		}
+		done[g] = true;
+		ret.push_back(std::move(groups[g]));
+
+		for (auto succ : successors[g]) {
+			if (!done[succ] && --num_predecessors[succ] == 0) {
+				ready.push(succ);
+			}
+		}
+	}
+
+	return ret;
+}
+} // namespace
+
+namespace {
+// Writes styles in deterministic order.
+// The styles are sorted by property groups and within a group are sorted by rule "name".
+void write_sorted(
+	buffered_writer& w,
+	utki::span<const style> styles,
+	utki::span<const property_list> property_lists,
+	const std::function<std::string(uint32_t)>& property_id_to_name,
+	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+	const sheet::write_options& options
+)
+{
+	// All names and property lists are formatted into two big strings to avoid memory allocation per string.
+	std::string names;
+	std::string props;
+
+	// formatted property lists by property list index
+	std::vector<std::optional<string_range>> props_map(property_lists.size());
+
+	struct entry {
+		string_range name;
+		size_t properties_index;
+		string_range props;
+	};
+
+	std::vector<entry> entries;
+	entries.reserve(styles.size());
+
+	for (const auto& s : styles) {
+		ASSERT(s.properties_index < property_lists.size())
+		auto& formatted_props = props_map[s.properties_index];
+		if (!formatted_props.has_value()) {
+			auto begin = props.size();
+			append_properties(
+				props, //
+				property_lists[s.properties_index],
+				property_id_to_name,
+				property_value_to_string,
+				options.minify
+			);
+			// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+			formatted_props = string_range{begin, props.size()};
+		}
+
+		auto begin = names.size();
+		append_name(names, s, options.minify);
+
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		entries.push_back(entry{
+			{begin, names.size()},
+			s.properties_index,
+			formatted_props.value()
+		});
+	}
+
+	std::sort(
+		entries.begin(), //
+		entries.end(),
+		[&names, &props](const auto& a, const auto& b) {
+			// sort by property_list to make consequent gropus using same property list by name within group
+			auto a_props = a.props.get(props);
+			auto b_props = b.props.get(props);
+			if (a_props != b_props) {
+				return a_props < b_props;
+			}
+
+			// sort by name within the group
+			return a.name.get(names) < b.name.get(names);
+		}
+	);
+
+	for (auto i = entries.begin(); i != entries.end();) {
+		// Go through selector chains which refer to the same property set (selectors in the same selector group),
+		// such selector chains will go in a row.
+		auto group_begin = i;
+
+		if (!options.minify) {
+			w.write(options.indent);
+		}
+
+		for (; i != entries.end() && i->properties_index == group_begin->properties_index; ++i) {
+			if (i != group_begin) {
+				w.write(options.minify ? minified_comma : comma);
+			}
+			w.write(i->name.get(names));
+		}
+
+		if (options.minify) {
+			w.write(minified_open_curly_brace);
+			w.write(group_begin->props.get(props));
+			w.write(minified_close_curly_brace);
+		} else {
+			w.write(open_curly_brace);
+			w.write(options.indent);
+			w.write(tab_char);
+			w.write(group_begin->props.get(props));
+			w.write(new_line_char);
+			w.write(options.indent);
+			w.write(close_curly_brace);
+		}
+
+		w.flush_if_needed();
+	}
+}
+} // namespace
+
+namespace {
+// Writes styles in the source order, see make_selector_groups(), formatting directly into the output buffer.
+void write_unsorted(
+	buffered_writer& w,
+	utki::span<const style> styles,
+	utki::span<const property_list> property_lists,
+	const std::function<std::string(uint32_t)>& property_id_to_name,
+	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+	const sheet::write_options& options
+)
+{
+	auto groups = make_selector_groups(styles, property_lists.size());
+
+	auto& buf = w.get_buffer();
+
+	for (const auto& g : groups) {
+		if (!options.minify) {
+			buf.append(options.indent);
+		}
+
+		for (auto i = g.styles.begin(); i != g.styles.end(); ++i) {
+			if (i != g.styles.begin()) {
+				buf.append(options.minify ? minified_comma : comma);
+			}
+			append_name(buf, **i, options.minify);
+		}
+
+		if (options.minify) {
+			buf.append(minified_open_curly_brace);
+		} else {
+			buf.append(open_curly_brace).append(options.indent).append(tab_char);
+		}
+
+		append_properties(
+			buf, //
+			property_lists[g.properties_index],
+			property_id_to_name,
+			property_value_to_string,
+			options.minify
+		);
+
+		if (options.minify) {
+			buf.append(minified_close_curly_brace);
+		} else {
+			buf.append(new_line_char).append(options.indent).append(close_curly_brace);
+		}
+
+		w.flush_if_needed();
+	}
+}
+} // namespace
+
+void sheet::write(
+	fsif::file& fi,
+	const std::function<std::string(uint32_t)>& property_id_to_name,
+	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+	std::string_view indent
+) const
+{
+	write_options options;
+	options.indent = indent;
+
+	this->write(
+		fi, //
+		property_id_to_name,
+		property_value_to_string,
+		options
+	);
+}
+
+void sheet::write(
+	fsif::file& fi,
+	const std::function<std::string(uint32_t)>& property_id_to_name,
+	const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+	const write_options& options
+) const
+{
+	fsif::file::guard file_guard(fi, fsif::mode::create);
+
+	buffered_writer w(fi);
+
+	auto write_styles = [&](utki::span<const style> styles, const write_options& opts) {
+		if (opts.sort) {
+			write_sorted(
+				w, //
+				styles,
+				this->property_lists,
+				property_id_to_name,
+				property_value_to_string,
+				opts
+			);
+		} else {
+			write_unsorted(
+				w, //
+				styles,
+				this->property_lists,
+				property_id_to_name,
+				property_value_to_string,
+				opts
+			);
+		}
+	};
+
+	write_styles(this->styles, options);
+
+	// media blocks go after the unconditional styles, in their original order
+	std::string block_indent = std::string(options.indent).append(tab_char);
+	write_options block_options = options;
+	block_options.indent = block_indent;
+
+	for (const auto& b : this->media_blocks) {
+		if (options.minify) {
+			w.write(media_keyword);
+			w.write(b.condition.text);
+			w.write(minified_open_curly_brace);
+		} else {
+			w.write(options.indent);
+			w.write(media_keyword);
+			w.write(b.condition.text);
+			w.write(open_curly_brace);
+		}
+
+		write_styles(b.styles, block_options);
+
+		if (options.minify) {
+			w.write(minified_close_curly_brace);
+		} else {
+			w.write(options.indent);
+			w.write(close_curly_brace);
+		}
+	}
+
+	w.flush();
+}
+
+void sheet::sort_styles_by_specificity()
+{
+	sort_by_specificity(this->styles);
+
+	for (auto& b : this->media_blocks) {
+		sort_by_specificity(b.styles);
+	}
+}
+
+void style::update_specificity() noexcept
+{
+	this->specificity = calculate_specificity(this->selectors);
+}
+
+uint32_t cssom::calculate_specificity(const selector_chain& selectors) noexcept
+{
+	// According to CSS spec (https://www.w3.org/TR/2018/CR-selectors-3-20180130/#specificity) we need to:
+	// - count the number of ID selectors in the selector (= a)
+	// - count the number of class selectors, attributes selectors, and pseudo-classes in the selector (= b)
+	// - count the number of type selectors and pseudo-elements in the selector (= c)
+	// - ignore the universal selector
+	// and then concatenate the three numbers 'abc' (in a number system with a large base) to get the overall selector
+	// chain specificity.
+
+	unsigned num_ids = 0;
+	unsigned num_classes = 0;
+	unsigned num_types = 0;
+	for (auto& s : selectors) {
+		if (!s.id.empty()) {
+			++num_ids;
+		}
+		if (!s.tag.empty()) {
+			if (s.tag.back() != '*') { // if not a universal selector
+				++num_types;
+			}
+		}
+		num_classes += unsigned(s.classes.size());
+		num_classes += unsigned(s.attributes.size());
+		for (const auto& pc : s.pseudo_classes) {
+			if (pc.is_pseudo_element()) {
+				++num_types;
+			} else {
+				++num_classes;
+			}
+		}
+	}
+
+	using std::min;
+
+	unsigned max_val = utki::byte_mask;
+	return (uint32_t(min(max_val, num_ids)) << (utki::byte_bits * 2)) | //
+		(uint32_t(min(max_val, num_classes)) << utki::byte_bits) | //
+		uint32_t(min(max_val, num_types));
+}
+
+namespace {
+// checks everything except pseudo-classes
+bool is_matching_except_pseudo_classes(const selector& sel, const styleable& node)
+{
+	CSSOM_INSTRUMENTATION_COUNT(selector_matching_calls);
+
+	if (!sel.tag.empty() && sel.tag.back() != '*') {
+		if (sel.tag != node.get_tag()) {
+			return false;
+		}
+	}
+
+	if (!sel.id.empty()) {
+		if (sel.id != node.get_id()) {
+			return false;
+		}
+	}
+
+	auto nc = node.get_classes();
+	for (auto& cls : sel.classes) {
+		if (std::find(nc.begin(), nc.end(), cls) == nc.end()) {
+			return false;
+		}
+	}
+
+	for (const auto& a : sel.attributes) {
+		if (!a.is_matching(node)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+} // namespace
+
+bool selector::is_matching(const styleable& node) const
+{
+	// pseudo-classes cannot be checked without knowing the node's position in the document
+	if (!this->pseudo_classes.empty()) {
+		return false;
+	}
+
+	return is_matching_except_pseudo_classes(*this, node);
+}
+
+namespace {
+bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+} // namespace
+
+namespace {
+bool contains_word(std::string_view str, std::string_view word)
+{
+	for (size_t pos = 0; pos < str.size();) {
+		if (is_whitespace(str[pos])) {
+			++pos;
+			continue;
+		}
+
+		size_t word_end = pos;
+		for (; word_end != str.size() && !is_whitespace(str[word_end]); ++word_end) {
+		}
+
+		if (str.substr(pos, word_end - pos) == word) {
+			return true;
+		}
+
+		pos = word_end;
+	}
+	return false;
+}
+} // namespace
+
+bool selector::is_matching(xml_dom_crawler& crawler) const
+{
+	if (!is_matching_except_pseudo_classes(*this, crawler.get())) {
+		return false;
+	}
+
+	if (this->pseudo_classes.empty()) {
+		return true;
+	}
+
+	// get sibling position only once and only if there are structural pseudo-classes
+	std::optional<std::optional<sibling_position>> position;
+
+	for (const auto& pc : this->pseudo_classes) {
+		if (pc.type == pseudo_class_type::unsupported) {
+			return false;
+		}
+		if (!position.has_value()) {
+			position = crawler.get_sibling_position();
+		}
+		if (!pc.is_matching(position.value())) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool pseudo_class::is_matching(const std::optional<sibling_position>& position) const noexcept
+{
+	if (!position.has_value()) {
+		return false;
+	}
+
+	const auto& pos = position.value();
+	ASSERT(pos.index < pos.count)
+
+	switch (this->type) {
+		case pseudo_class_type::first_child:
+			return pos.index == 0;
+		case pseudo_class_type::last_child:
+			return pos.index + 1 == pos.count;
+		case pseudo_class_type::only_child:
+			return pos.count == 1;
+		case pseudo_class_type::nth_child:
+			{
+				// one-based index, 64 bits to avoid overflow in the calculations below
+				auto i = int64_t(pos.index) + 1;
+				if (this->a == 0) {
+					return i == this->b;
+				}
+				// need to find non-negative integer n such that a * n + b = i
+				auto d = i - this->b;
+				return d % this->a == 0 && d / this->a >= 0;
+			}
+		case pseudo_class_type::unsupported:
+		default:
+			return false;
+	}
+}
+
+namespace {
+// crawler calls are wrapped to be counted by instrumentation
+
+bool counted_move_up(xml_dom_crawler& crawler)
+{
+	CSSOM_INSTRUMENTATION_COUNT(crawler_move_up_calls);
+	return crawler.move_up();
+}
+
+bool counted_move_left(xml_dom_crawler& crawler)
+{
+	CSSOM_INSTRUMENTATION_COUNT(crawler_move_left_calls);
+	return crawler.move_left();
+}
+
+void counted_reset(xml_dom_crawler& crawler)
+{
+	CSSOM_INSTRUMENTATION_COUNT(crawler_reset_calls);
+	crawler.reset();
+}
+} // namespace
+
+std::optional<sibling_position> caching_xml_dom_crawler::get_sibling_position()
+{
+	const styleable* node = &this->get();
+
+	if (auto i = this->cache.positions.find(node); i != this->cache.positions.end()) {
+		return i->second;
+	}
+
+	// move to the first sibling
+	size_t index = 0;
+	for (; counted_move_left(*this); ++index) {
+	}
+
+	// scan all siblings
+	auto& siblings = this->cache.siblings;
+	siblings.clear();
+	do {
+		siblings.push_back(&this->get());
+	} while (this->move_right());
+
+	auto count = siblings.size();
+	ASSERT(index < count)
+
+	for (size_t i = 0; i != count; ++i) {
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		this->cache.positions[siblings[i]] = sibling_position{i, count};
+	}
+
+	// move back to the original node
+	for (size_t i = count - 1; i != index; --i) {
+		[[maybe_unused]] bool moved = counted_move_left(*this);
+		ASSERT(moved)
+	}
+	ASSERT(&this->get() == node)
+
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	return sibling_position{index, count};
+}
+
+bool attribute_selector::is_matching(const styleable& node) const
+{
+	auto v = node.get_attribute(this->name);
+	if (!v.has_value()) {
+		return false;
+	}
+
+	const auto& val = v.value();
+
+	// According to CSS spec, [attr~=value], [attr^=value], [attr$=value] and [attr*=value] selectors
+	// never match if the value is empty, also [attr~=value] never matches if the value contains whitespace.
+	switch (this->operation) {
+		case attribute_operation::exists:
+			return true;
+		case attribute_operation::equals:
+			return val == this->value;
+		case attribute_operation::includes:
+			if (this->value.empty() || std::any_of(this->value.begin(), this->value.end(), is_whitespace)) {
+				return false;
+			}
+			return contains_word(val, this->value);
+		case attribute_operation::dash_match:
+			if (val.size() == this->value.size()) {
+				return val == this->value;
+			}
+			return val.size() > this->value.size() && val[this->value.size()] == '-' &&
+				val.substr(0, this->value.size()) == this->value;
+		case attribute_operation::prefix:
+			return !this->value.empty() && val.size() >= this->value.size() &&
+				val.substr(0, this->value.size()) == this->value;
+		case attribute_operation::suffix:
+			return !this->value.empty() && val.size() >= this->value.size() &&
+				val.substr(val.size() - this->value.size()) == this->value;
+		case attribute_operation::substring:
+			return !this->value.empty() && val.find(this->value) != std::string_view::npos;
+	}
+	return false;
+}
+
+std::string_view cssom::intern(std::string_view str)
+{
+	static std::mutex mutex;
+	// std::set is a node based container, so stored strings never move in memory
+	static std::set<std::string, std::less<>> strings;
+
+	std::lock_guard<std::mutex> lock_guard(mutex);
+
+	// look up first, so that no string is constructed for already interned ones
+	auto i = strings.lower_bound(str);
+	if (i == strings.end() || *i != str) {
+		i = strings.emplace_hint(i, str);
+	}
+	return *i;
+}
+
+namespace {
+bool is_descendant_matching(xml_dom_crawler& crawler, const selector& sel)
+{
+	while (counted_move_up(crawler)) {
+		if (sel.is_matching(crawler)) {
+			return true;
+		}
+	}
+	return false;
+}
+} // namespace
+
+namespace {
+bool is_child_matching(xml_dom_crawler& crawler, const selector& sel)
+{
+	if (!counted_move_up(crawler)) {
+		return false;
+	}
+	return sel.is_matching(crawler);
 }
 } // namespace
 
 namespace {
 bool is_next_sibling_matching(xml_dom_crawler& crawler, const selector& sel)
 {
-	if (!crawler.move_left()) {
+	if (!counted_move_left(crawler)) {
 		return false;
 	}
-	return sel.is_matching(crawler.get());
+	return sel.is_matching(crawler);
 }
 } // namespace
 
 namespace {
 bool is_subsequent_sibling_matching(xml_dom_crawler& crawler, const selector& sel)
 {
-	while (crawler.move_left()) {
-		if (sel.is_matching(crawler.get())) {
+	while (counted_move_left(crawler)) {
+		if (sel.is_matching(crawler)) {
 			return true;
 		}
 	}
@@ -509,49 +1512,340 @@ bool is_subsequent_sibling_matching(xml_dom_crawler& crawler, const selector& se
 }
 } // namespace
 
-bool style::is_matching(xml_dom_crawler& crawler) const
+namespace {
+// Greedy matching picks the nearest ancestor or sibling which matches the selector and never reconsiders
+// the choice. If it fails, the result is exact only if the failed part of the chain cannot match from
+// the picked node while it could match from a farther candidate.
+// This holds when every further combinator only widens the set of reachable nodes as the picked candidate
+// gets nearer, e.g. for pure descendant chains like 'a b c' or for 'a > b ~ c', but not for 'a > b c'.
+// Returns the first selector, from the right, such that greedy failure to match the selector
+// does not mean that the chain does not match, or rend() if greedy matching of the chain is exact.
+selector_chain::const_reverse_iterator find_greedy_matching_inexact(const selector_chain& selectors)
+{
+	enum class candidates {
+		single,
+		siblings,
+		ancestors
+	};
+
+	auto state = candidates::single;
+
+	auto i = selectors.rbegin();
+	if (i == selectors.rend()) {
+		return i;
+	}
+
+	for (++i; i != selectors.rend(); ++i) {
+		switch (i->combinator) {
+			case combinator::none:
+				break;
+			case combinator::descendant:
+				// ancestors of any candidate sibling are the same,
+				// ancestors of nearer ancestor candidate include ancestors of farther ones
+				state = candidates::ancestors;
+				break;
+			case combinator::child:
+				if (state == candidates::ancestors) {
+					return i;
+				}
+				// all candidate siblings have same parent
+				state = candidates::single;
+				break;
+			case combinator::next_sibling:
+				if (state != candidates::single) {
+					return i;
+				}
+				break;
+			case combinator::subsequent_sibling:
+				if (state == candidates::ancestors) {
+					return i;
+				}
+				// preceding siblings of nearer candidate sibling include preceding siblings of farther ones
+				state = candidates::siblings;
+				break;
+		}
+	}
+
+	return i;
+}
+} // namespace
+
+namespace {
+// Matching with backtracking over all ancestor and sibling candidates.
+// Since crawler cannot save and restore its position, all the nodes reachable from the initial node
+// are walked once, recording the selectors each node matches, and then the matching is done on the recorded nodes.
+// Memoization makes sure that the rest of the chain is tried at most once from each (selector, node) pair and
+// that each node is scanned at most once for each selector, so the matching takes
+// O(chain length * number of reachable nodes) steps instead of being exponential.
+class backtracking_matcher
+{
+	constexpr static auto no_node = std::numeric_limits<size_t>::max();
+
+	const selector_chain& selectors;
+
+	struct node {
+		size_t parent = no_node;
+		size_t prev_sibling = no_node;
+	};
+
+	std::vector<node> nodes;
+
+	// per node, per selector flags, indexed by node * selectors.size() + selector
+	std::vector<bool> matches;
+
+	// rest of the chain to the left of the selector does not match from the node
+	std::vector<bool> failed;
+
+	// the node has been visited by a scan for the selector,
+	// scans which reach the node will not find a match beyond it
+	std::vector<bool> scanned;
+
+	size_t flag_index(size_t node_index, size_t selector_index) const noexcept
+	{
+		return node_index * this->selectors.size() + selector_index;
+	}
+
+	size_t add_node(xml_dom_crawler& crawler)
+	{
+		this->nodes.emplace_back();
+		for (const auto& sel : this->selectors) {
+			this->matches.push_back(sel.is_matching(crawler));
+		}
+		return this->nodes.size() - 1;
+	}
+
+	void walk(xml_dom_crawler& crawler, bool with_siblings)
+	{
+		size_t cur = this->add_node(crawler);
+
+		for (;;) {
+			if (with_siblings) {
+				for (size_t n = cur; counted_move_left(crawler);) {
+					size_t sibling = this->add_node(crawler);
+					this->nodes[n].prev_sibling = sibling;
+					n = sibling;
+				}
+			}
+
+			if (!counted_move_up(crawler)) {
+				break;
+			}
+
+			size_t parent = this->add_node(crawler);
+
+			// the current node and its preceding siblings were added last
+			for (size_t n = cur; n != parent; ++n) {
+				this->nodes[n].parent = parent;
+			}
+
+			cur = parent;
+		}
+
+		this->failed.resize(this->matches.size());
+		this->scanned.resize(this->matches.size());
+	}
+
+	size_t step(size_t node_index, combinator c) const noexcept
+	{
+		const auto& n = this->nodes[node_index];
+		switch (c) {
+			case combinator::descendant:
+			case combinator::child:
+				return n.parent;
+			case combinator::next_sibling:
+			case combinator::subsequent_sibling:
+				return n.prev_sibling;
+			case combinator::none:
+			default:
+				ASSERT(false)
+				return no_node;
+		}
+	}
+
+	// the node is expected to match this->selectors[selector_index]
+	bool match_from(size_t node_index, size_t selector_index)
+	{
+		if (selector_index == 0) {
+			return true;
+		}
+
+		auto fi = this->flag_index(node_index, selector_index);
+		if (this->failed[fi]) {
+			return false;
+		}
+
+		if (this->match_next(node_index, selector_index - 1)) {
+			return true;
+		}
+
+		this->failed[fi] = true;
+		return false;
+	}
+
+	bool match_next(size_t node_index, size_t selector_index)
+	{
+		auto c = this->selectors[selector_index].combinator;
+
+		if (c == combinator::child || c == combinator::next_sibling) {
+			auto n = this->step(node_index, c);
+			if (n == no_node || !this->matches[this->flag_index(n, selector_index)]) {
+				return false;
+			}
+			return this->match_from(n, selector_index);
+		}
+
+		for (auto n = this->step(node_index, c); n != no_node; n = this->step(n, c)) {
+			auto fi = this->flag_index(n, selector_index);
+			if (this->scanned[fi]) {
+				break;
+			}
+			// In case the scan succeeds the whole chain matches and the flag does not matter anymore.
+			this->scanned[fi] = true;
+
+			if (this->matches[fi] && this->match_from(n, selector_index)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+public:
+	backtracking_matcher(xml_dom_crawler& crawler, const selector_chain& selectors) :
+		selectors(selectors)
+	{
+		ASSERT(!this->selectors.empty())
+
+		bool with_siblings = std::any_of(
+			this->selectors.begin(), //
+			this->selectors.end(),
+			[](const auto& sel) {
+				return sel.combinator == combinator::next_sibling ||
+					sel.combinator == combinator::subsequent_sibling;
+			}
+		);
+
+		this->walk(crawler, with_siblings);
+	}
+
+	bool match()
+	{
+		ASSERT(!this->nodes.empty())
+		if (!this->matches[this->flag_index(0, this->selectors.size() - 1)]) {
+			return false;
+		}
+
+		// the initial node is node 0
+		return this->match_from(0, this->selectors.size() - 1);
+	}
+};
+} // namespace
+
+namespace {
+// Returns the selector which failed to match, or rend() if the whole chain has matched.
+selector_chain::const_reverse_iterator match_greedily(const selector_chain& selectors, xml_dom_crawler& crawler)
 {
-	for (auto i = this->selectors.rbegin(); i != this->selectors.rend(); ++i) {
+	for (auto i = selectors.rbegin(); i != selectors.rend(); ++i) {
 		switch (i->combinator) {
 			case combinator::none:
-				if (!i->is_matching(crawler.get())) {
-					return false;
+				if (!i->is_matching(crawler)) {
+					if (i == selectors.rbegin()) {
+						CSSOM_INSTRUMENTATION_COUNT(early_rejects);
+					}
+					return i;
 				}
 				break;
 			case combinator::descendant:
 				if (!is_descendant_matching(crawler, *i)) {
-					return false;
+					return i;
 				}
 				break;
 			case combinator::child:
 				if (!is_child_matching(crawler, *i)) {
-					return false;
+					return i;
 				}
 				break;
 			case combinator::next_sibling:
 				if (!is_next_sibling_matching(crawler, *i)) {
-					return false;
+					return i;
 				}
 				break;
 			case combinator::subsequent_sibling:
 				if (!is_subsequent_sibling_matching(crawler, *i)) {
-					return false;
+					return i;
 				}
 				break;
 		}
 	}
 
-	return true;
+	return selectors.rend();
+}
+} // namespace
+
+namespace {
+bool is_style_matching(const style& st, xml_dom_crawler& crawler)
+{
+	// Greedy matching is fast and in most cases gives exact result,
+	// so try it first and fall back to backtracking only when its failure is not conclusive.
+	auto failed = match_greedily(st.selectors, crawler);
+	if (failed == st.selectors.rend()) {
+		return true;
+	}
+
+	if (failed < find_greedy_matching_inexact(st.selectors)) {
+		return false;
+	}
+
+	counted_reset(crawler);
+	return backtracking_matcher(crawler, st.selectors).match();
+}
+} // namespace
+
+bool style::is_matching(xml_dom_crawler& crawler) const
+{
+#ifdef CSSOM_INSTRUMENTATION
+	if (instrumentation::is_profiling_enabled()) {
+		const auto& counters = instrumentation::get_counters();
+		auto steps_before = counters.crawler_move_up_calls + counters.crawler_move_left_calls;
+		auto start = std::chrono::steady_clock::now();
+
+		bool matched = is_style_matching(*this, crawler);
+
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		instrumentation::detail::record_style_matching(
+			*this, //
+			matched,
+			counters.crawler_move_up_calls + counters.crawler_move_left_calls - steps_before,
+			std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+		);
+		return matched;
+	}
+#endif
+
+	return is_style_matching(*this, crawler);
+}
+
+std::string style::get_name() const
+{
+	std::string ret;
+	append_name(ret, *this, false);
+	return ret;
 }
 
 sheet::query_result sheet::get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const
 {
+	CSSOM_INSTRUMENTATION_COUNT(queries);
+
 	for (auto& s : this->styles) {
-		crawler.reset();
+		CSSOM_INSTRUMENTATION_COUNT(rules_examined);
+
+		counted_reset(crawler);
 
 		if (s.is_matching(crawler)) {
-			auto i = s.properties->find(property_id);
-			if (i != s.properties->end()) {
+			CSSOM_INSTRUMENTATION_COUNT(matches);
+			const auto& props = this->get_properties(s);
+			auto i = props.find(property_id);
+			if (i != props.end()) {
 				// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
 				return query_result{i->second.get(), s.specificity};
 			}
@@ -562,11 +1856,147 @@ sheet::query_result sheet::get_property_value(xml_dom_crawler& crawler, uint32_t
 	return query_result{nullptr, 0};
 }
 
+size_t sheet::get_property_values(
+	xml_dom_crawler& crawler,
+	utki::span<const uint32_t> property_ids,
+	utki::span<query_result> out
+) const
+{
+	return detail::get_property_values(
+		this->styles, //
+		[this](const style& s) -> const property_list& {
+			return this->get_properties(s);
+		},
+		crawler,
+		property_ids,
+		out
+	);
+}
+
 void sheet::append(sheet d)
 {
-	using std::begin;
-	using std::end;
-	std::move(begin(d.styles), end(d.styles), std::back_inserter(this->styles));
-	d.styles.clear();
-	this->sort_styles_by_specificity();
+	ASSERT(std::is_sorted(
+		this->styles.begin(), //
+		this->styles.end(),
+		[](const auto& a, const auto& b) {
+			return a.specificity > b.specificity;
+		}
+	))
+	ASSERT(std::is_sorted(
+		d.styles.begin(), //
+		d.styles.end(),
+		[](const auto& a, const auto& b) {
+			return a.specificity > b.specificity;
+		}
+	))
+
+	// move property lists of the appended sheet to the end of the pool
+	auto offset = this->property_lists.size();
+	if (this->property_lists.empty()) {
+		this->property_lists = std::move(d.property_lists);
+	} else {
+		this->property_lists.reserve(offset + d.property_lists.size());
+		std::move(d.property_lists.begin(), d.property_lists.end(), std::back_inserter(this->property_lists));
+	}
+	for (auto& s : d.styles) {
+		s.properties_index += offset;
+	}
+	for (auto& b : d.media_blocks) {
+		for (auto& s : b.styles) {
+			s.properties_index += offset;
+		}
+		this->media_blocks.push_back(std::move(b));
+	}
+
+	merge_styles(this->styles, std::move(d.styles));
+}
+
+void sheet::remove_unused_property_lists()
+{
+	constexpr auto unused = std::numeric_limits<size_t>::max();
+
+	// old index to new index
+	std::vector<size_t> new_indices(this->property_lists.size(), unused);
+
+	auto mark_used = [&new_indices](const std::vector<style>& styles) {
+		for (const auto& s : styles) {
+			ASSERT(s.properties_index < new_indices.size())
+			new_indices[s.properties_index] = 0;
+		}
+	};
+
+	mark_used(this->styles);
+	for (const auto& b : this->media_blocks) {
+		mark_used(b.styles);
+	}
+
+	size_t num_used = 0;
+	for (size_t i = 0; i != this->property_lists.size(); ++i) {
+		if (new_indices[i] == unused) {
+			continue;
+		}
+		new_indices[i] = num_used;
+		if (i != num_used) {
+			this->property_lists[num_used] = std::move(this->property_lists[i]);
+		}
+		++num_used;
+	}
+	this->property_lists.resize(num_used);
+
+	for (auto& s : this->styles) {
+		s.properties_index = new_indices[s.properties_index];
+	}
+	for (auto& b : this->media_blocks) {
+		for (auto& s : b.styles) {
+			s.properties_index = new_indices[s.properties_index];
+		}
+	}
+}
+
+namespace {
+// returns range of styles of given specificity
+auto equal_specificity_range(std::vector<style>& styles, uint32_t specificity)
+{
+	struct comparator {
+		bool operator()(const style& s, uint32_t spec) const noexcept
+		{
+			return s.specificity > spec; // descending order
+		}
+
+		bool operator()(uint32_t spec, const style& s) const noexcept
+		{
+			return spec > s.specificity; // descending order
+		}
+	};
+
+	return std::equal_range(styles.begin(), styles.end(), specificity, comparator());
+}
+} // namespace
+
+size_t sheet::insert_style(style s)
+{
+	ASSERT(s.specificity == calculate_specificity(s.selectors))
+
+	// insert before all styles of equal specificity, so that the inserted style takes precedence over them
+	auto i = equal_specificity_range(this->styles, s.specificity).first;
+
+	i = this->styles.insert(i, std::move(s));
+
+	return size_t(std::distance(this->styles.begin(), i));
+}
+
+std::vector<style> sheet::remove_style(const selector_chain& selectors)
+{
+	auto range = equal_specificity_range(this->styles, calculate_specificity(selectors));
+
+	// move the styles to remove to the end of the range, keeping the order of the rest
+	auto i = std::stable_partition(range.first, range.second, [&selectors](const auto& s) {
+		return s.selectors != selectors;
+	});
+
+	std::vector<style> ret(std::make_move_iterator(i), std::make_move_iterator(range.second));
+
+	this->styles.erase(i, range.second);
+
+	return ret;
 }
@@ -26,12 +26,25 @@ SOFTWARE.
 
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include <fsif/file.hpp>
+#include <utki/debug.hpp>
 #include <utki/destructable.hpp>
 #include <utki/span.hpp>
 
+#include "parser.hpp"
+
 namespace cssom {
 
 struct styleable {
@@ -40,6 +53,20 @@ struct styleable {
 
 	virtual utki::span<const std::string> get_classes() const = 0;
 
+	/**
+	 * @brief Get attribute value.
+	 * The attribute name passed in is always interned with cssom::intern(), so implementations
+	 * which intern their attribute names with cssom::intern() as well can compare names by pointer.
+	 * The default implementation reports that the node has no attributes.
+	 * @param name - name of the attribute.
+	 * @return value of the attribute.
+	 * @return std::nullopt if the node does not have the requested attribute.
+	 */
+	virtual std::optional<std::string_view> get_attribute(std::string_view name) const
+	{
+		return std::nullopt;
+	}
+
 	styleable() = default;
 
 	styleable(const styleable&) = default;
@@ -51,6 +78,21 @@ struct styleable {
 	virtual ~styleable() noexcept = default;
 };
 
+/**
+ * @brief Position of a node among its siblings.
+ */
+struct sibling_position {
+	/**
+	 * @brief Zero-based index of the node among its siblings.
+	 */
+	size_t index;
+
+	/**
+	 * @brief Number of siblings, including the node itself.
+	 */
+	size_t count;
+};
+
 struct xml_dom_crawler {
 	virtual const styleable& get() = 0;
 
@@ -75,6 +117,21 @@ struct xml_dom_crawler {
 	 */
 	virtual void reset() = 0;
 
+	/**
+	 * @brief Get position of the current node among its siblings.
+	 * This is an optional capability which is used to match structural pseudo-classes, like :first-child.
+	 * Crawlers which can tell the position in O(1) should override this function.
+	 * For crawlers which cannot do that, see cssom::caching_xml_dom_crawler.
+	 * The default implementation reports that the position is unknown,
+	 * in which case structural pseudo-classes do not match.
+	 * @return position of the current node among its siblings.
+	 * @return std::nullopt if the position is unknown.
+	 */
+	virtual std::optional<sibling_position> get_sibling_position()
+	{
+		return std::nullopt;
+	}
+
 	xml_dom_crawler() = default;
 
 	xml_dom_crawler(const xml_dom_crawler&) = default;
@@ -86,6 +143,54 @@ struct xml_dom_crawler {
 	virtual ~xml_dom_crawler() noexcept = default;
 };
 
+/**
+ * @brief Cache of node positions among their siblings.
+ * The cache is supposed to live during a batch of queries to a document, for example during styling of the whole
+ * document, and is to be cleared whenever the document structure changes.
+ * The nodes are identified by addresses of their cssom::styleable objects,
+ * so those addresses have to stay valid during the cache lifetime.
+ */
+class sibling_cache
+{
+	friend class caching_xml_dom_crawler;
+
+	std::unordered_map<const styleable*, sibling_position> positions;
+
+	// scratch buffer to avoid memory allocation on each siblings scan
+	std::vector<const styleable*> siblings;
+
+public:
+	void clear() noexcept
+	{
+		this->positions.clear();
+	}
+};
+
+/**
+ * @brief Crawler which finds out sibling positions by scanning the siblings.
+ * The scan is done once per parent node, results are stored in the cache for all the siblings,
+ * so that further queries during the batch take O(1).
+ * This requires the crawler to be able to move to the following sibling.
+ */
+class caching_xml_dom_crawler : public xml_dom_crawler
+{
+	sibling_cache& cache;
+
+public:
+	caching_xml_dom_crawler(sibling_cache& cache) :
+		cache(cache)
+	{}
+
+	/**
+	 * @brief Move crawler to following sibling.
+	 * @return true if moved.
+	 * @return false if already at the last node, could not move to the following node.
+	 */
+	virtual bool move_right() = 0;
+
+	std::optional<sibling_position> get_sibling_position() override;
+};
+
 // TODO: doxygen all
 enum class combinator {
 	none,
@@ -95,6 +200,155 @@ enum class combinator {
 	subsequent_sibling
 };
 
+/**
+ * @brief Intern a string.
+ * Returns a view of the string stored in the process-wide table of interned strings.
+ * The same view is returned for all equal strings, the stored strings are never freed.
+ * The function is thread-safe.
+ * @param str - string to intern.
+ * @return view of the interned string.
+ */
+std::string_view intern(std::string_view str);
+
+/**
+ * @brief Attribute selector value matching operation.
+ */
+enum class attribute_operation {
+	/**
+	 * @brief [attr]
+	 * Attribute is present.
+	 */
+	exists,
+
+	/**
+	 * @brief [attr=value]
+	 * Attribute value is exactly the value.
+	 */
+	equals,
+
+	/**
+	 * @brief [attr~=value]
+	 * Attribute value is a whitespace-separated list of words, one of which is exactly the value.
+	 */
+	includes,
+
+	/**
+	 * @brief [attr|=value]
+	 * Attribute value is exactly the value or begins with the value immediately followed by '-'.
+	 */
+	dash_match,
+
+	/**
+	 * @brief [attr^=value]
+	 * Attribute value begins with the value.
+	 */
+	prefix,
+
+	/**
+	 * @brief [attr$=value]
+	 * Attribute value ends with the value.
+	 */
+	suffix,
+
+	/**
+	 * @brief [attr*=value]
+	 * Attribute value contains the value as a substring.
+	 */
+	substring
+};
+
+/**
+ * @brief Attribute selector.
+ * The attribute selector is specified with square brackets in the CSS.
+ */
+struct attribute_selector {
+	/**
+	 * @brief Attribute name.
+	 * The name is interned with cssom::intern().
+	 */
+	std::string_view name;
+
+	attribute_operation operation = attribute_operation::exists;
+
+	/**
+	 * @brief Attribute value to match.
+	 * Not used for attribute_operation::exists.
+	 */
+	std::string value;
+
+	bool is_matching(const styleable& node) const;
+
+	bool operator==(const attribute_selector& s) const noexcept
+	{
+		return this->name == s.name && this->operation == s.operation && this->value == s.value;
+	}
+
+	bool operator!=(const attribute_selector& s) const noexcept
+	{
+		return !this->operator==(s);
+	}
+};
+
+/**
+ * @brief Pseudo-class type.
+ */
+enum class pseudo_class_type {
+	/**
+	 * @brief Pseudo-class or pseudo-element which is not supported.
+	 * Selectors with unsupported pseudo-classes never match.
+	 */
+	unsupported,
+	first_child,
+	last_child,
+	only_child,
+	nth_child
+};
+
+/**
+ * @brief Pseudo-class selector.
+ * The pseudo-class is specified with ':' in the CSS.
+ */
+struct pseudo_class {
+	pseudo_class_type type = pseudo_class_type::unsupported;
+
+	/**
+	 * @brief Pseudo-class name.
+	 * The name is interned with cssom::intern().
+	 * Pseudo-element names begin with ':'.
+	 */
+	std::string_view name;
+
+	/**
+	 * @brief Argument of functional pseudo-class.
+	 * E.g. "2n+1" for :nth-child(2n+1).
+	 */
+	std::string argument;
+
+	/**
+	 * @brief Coefficients of the :nth-child(an+b) formula.
+	 */
+	int a = 0;
+	int b = 0;
+
+	bool is_pseudo_element() const noexcept
+	{
+		return !this->name.empty() && this->name.front() == ':';
+	}
+
+	bool is_matching(const std::optional<sibling_position>& position) const noexcept;
+
+	bool operator==(const pseudo_class& pc) const noexcept
+	{
+		// type, a and b are derived from name and argument
+		return this->name == pc.name && this->argument == pc.argument;
+	}
+
+	bool operator!=(const pseudo_class& pc) const noexcept
+	{
+		return !this->operator==(pc);
+	}
+};
+
 /**
  * @brief Simple CSS selector.
  * The 'simple selector' term is defined in CSS spec.
@@ -117,42 +371,739 @@ struct selector {
 
 	std::vector<std::string> classes;
 
-	// TODO: attribute selectors, pseudo-class, pseudo-element etc.
+	std::vector<attribute_selector> attributes;
+
+	std::vector<pseudo_class> pseudo_classes;
 
 	/**
 	 * @brief Combinator with next selector in the selector chain.
 	 */
 	cssom::combinator combinator = cssom::combinator::none;
 
+	/**
+	 * @brief Check if node matches the selector.
+	 * Pseudo-classes require knowing the node's position in the document,
+	 * so selectors having pseudo-classes never match a bare node,
+	 * use is_matching(xml_dom_crawler&) for those.
+	 * @param node - node to check.
+	 * @return true if the node matches the selector.
+	 * @return false if the node does not match the selector or the selector has pseudo-classes.
+	 */
 	bool is_matching(const styleable& node) const;
+
+	/**
+	 * @brief Check if current node of the crawler matches the selector.
+	 * @param crawler - crawler pointing to the node to check.
+	 * @return true if the node matches the selector.
+	 */
+	bool is_matching(xml_dom_crawler& crawler) const;
+
+	bool operator==(const selector& s) const noexcept
+	{
+		return this->id == s.id && this->tag == s.tag && this->classes == s.classes &&
+			this->attributes == s.attributes && this->pseudo_classes == s.pseudo_classes &&
+			this->combinator == s.combinator;
+	}
+
+	bool operator!=(const selector& s) const noexcept
+	{
+		return !this->operator==(s);
+	}
 };
 
 struct property_value_base : public utki::destructable {};
 
+/**
+ * @brief Owning holder of a property value.
+ * Small values, which fit into the holder's inline buffer, are stored inside the holder, without heap allocation.
+ * Bigger values are allocated on the heap.
+ * Use cssom::make_property_value() to create values which are stored inline when possible.
+ * Values passed in as std::unique_ptr are always kept on the heap.
+ * The holder is copyable: inline values are copied, while values on the heap are shared between the copies,
+ * so property values are supposed to be immutable once they are put to a holder.
+ */
+class property_value_holder
+{
+public:
+	/**
+	 * @brief Size of the inline buffer.
+	 * It is enough for a value holding a pointer sized scalar, e.g. an enum, a float or a color,
+	 * along with the virtual table pointer.
+	 */
+	constexpr static size_t inline_size = 2 * sizeof(void*);
+
+	/**
+	 * @brief Check if values of the given type are stored inline.
+	 * @tparam value_type - type of the value.
+	 */
+	template <typename value_type>
+	constexpr static bool is_stored_inline = sizeof(value_type) <= inline_size &&
+		alignof(value_type) <= alignof(void*) && std::is_nothrow_move_constructible_v<value_type> &&
+		std::is_copy_constructible_v<value_type>;
+
+private:
+	// Values on the heap are shared between the holder copies,
+	// the owning pointer to such value is stored in the inline buffer.
+	using heap_pointer = std::shared_ptr<property_value_base>;
+
+	static_assert(sizeof(heap_pointer) <= inline_size, "shared pointer does not fit into the inline buffer");
+	static_assert(alignof(heap_pointer) <= alignof(void*), "shared pointer alignment is too big for the inline buffer");
+
+	// operations on the contents of the inline buffer
+	struct buffer_operations {
+		// Move-constructs the contents at 'to' from the contents at 'from' and destroys the contents at 'from'.
+		// Returns pointer to the value.
+		property_value_base* (*relocate)(void* from, void* to) noexcept;
+
+		// Copy-constructs the contents at 'to' from the contents at 'from'.
+		// Returns pointer to the value.
+		property_value_base* (*copy)(const void* from, void* to);
+
+		void (*destroy)(void* p) noexcept;
+
+		bool is_inline;
+	};
+
+	alignas(void*) std::array<uint8_t, inline_size> buffer;
+
+	property_value_base* value = nullptr;
+
+	// nullptr if there is no value
+	const buffer_operations* operations = nullptr;
+
+	template <typename contents_type>
+	static contents_type* get_contents(void* p) noexcept
+	{
+		return std::launder(reinterpret_cast<contents_type*>(p));
+	}
+
+	template <typename contents_type>
+	static const contents_type* get_contents(const void* p) noexcept
+	{
+		return std::launder(reinterpret_cast<const contents_type*>(p));
+	}
+
+	static property_value_base* get_value(property_value_base* v) noexcept
+	{
+		return v;
+	}
+
+	static property_value_base* get_value(heap_pointer* v) noexcept
+	{
+		return v->get();
+	}
+
+	template <typename contents_type>
+	static property_value_base* relocate_contents(void* from, void* to) noexcept
+	{
+		auto f = get_contents<contents_type>(from);
+		auto t = new (to) contents_type(std::move(*f));
+		f->~contents_type();
+		return get_value(t);
+	}
+
+	template <typename contents_type>
+	static property_value_base* copy_contents(const void* from, void* to)
+	{
+		return get_value(new (to) contents_type(*get_contents<contents_type>(from)));
+	}
+
+	template <typename contents_type>
+	static void destroy_contents(void* p) noexcept
+	{
+		get_contents<contents_type>(p)->~contents_type();
+	}
+
+	template <typename contents_type>
+	static const buffer_operations& get_operations() noexcept
+	{
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		constexpr static buffer_operations ops{
+			&relocate_contents<contents_type>,
+			&copy_contents<contents_type>,
+			&destroy_contents<contents_type>,
+			!std::is_same_v<contents_type, heap_pointer>
+		};
+		return ops;
+	}
+
+	void set_heap_value(heap_pointer v) noexcept
+	{
+		if (!v) {
+			return;
+		}
+		this->value = v.get();
+		new (this->buffer.data()) heap_pointer(std::move(v));
+		this->operations = &get_operations<heap_pointer>();
+	}
+
+	void take(property_value_holder& h) noexcept
+	{
+		if (h.operations) {
+			this->value = h.operations->relocate(h.buffer.data(), this->buffer.data());
+			this->operations = h.operations;
+		}
+
+		h.value = nullptr;
+		h.operations = nullptr;
+	}
+
+public:
+	property_value_holder() noexcept = default;
+
+	// NOLINTNEXTLINE(google-explicit-constructor, "allow implicit conversion from nullptr, same as std::unique_ptr")
+	property_value_holder(std::nullptr_t) noexcept {}
+
+	template <
+		typename value_type,
+		std::enable_if_t<std::is_base_of_v<property_value_base, value_type>, bool> = true>
+	// NOLINTNEXTLINE(google-explicit-constructor, "allow implicit conversion from std::unique_ptr")
+	property_value_holder(std::unique_ptr<value_type> v)
+	{
+		this->set_heap_value(std::move(v));
+	}
+
+	property_value_holder(const property_value_holder& h)
+	{
+		if (h.operations) {
+			this->value = h.operations->copy(h.buffer.data(), this->buffer.data());
+			this->operations = h.operations;
+		}
+	}
+
+	property_value_holder& operator=(const property_value_holder& h)
+	{
+		if (this != &h) {
+			property_value_holder copy(h);
+			this->reset();
+			this->take(copy);
+		}
+		return *this;
+	}
+
+	property_value_holder(property_value_holder&& h) noexcept
+	{
+		this->take(h);
+	}
+
+	property_value_holder& operator=(property_value_holder&& h) noexcept
+	{
+		if (this != &h) {
+			this->reset();
+			this->take(h);
+		}
+		return *this;
+	}
+
+	~property_value_holder()
+	{
+		this->reset();
+	}
+
+	/**
+	 * @brief Construct new value in the holder.
+	 * The previously held value is destroyed.
+	 * @tparam value_type - type of the value to construct.
+	 * @param args - arguments of the value constructor.
+	 * @return reference to the constructed value.
+	 */
+	template <typename value_type, typename... arguments_type>
+	value_type& emplace(arguments_type&&... args)
+	{
+		static_assert(std::is_base_of_v<property_value_base, value_type>, "value must derive from property_value_base");
+
+		this->reset();
+
+		if constexpr (is_stored_inline<value_type>) {
+			auto v = new (this->buffer.data()) value_type(std::forward<arguments_type>(args)...);
+			this->value = v;
+			this->operations = &get_operations<value_type>();
+			return *v;
+		} else {
+			auto v = std::make_shared<value_type>(std::forward<arguments_type>(args)...);
+			auto& ret = *v;
+			this->set_heap_value(std::move(v));
+			return ret;
+		}
+	}
+
+	void reset() noexcept
+	{
+		if (!this->operations) {
+			return;
+		}
+
+		this->operations->destroy(this->buffer.data());
+
+		this->value = nullptr;
+		this->operations = nullptr;
+	}
+
+	/**
+	 * @brief Check if the value is stored inline.
+	 * @return true if the holder has a value and the value is stored in the inline buffer.
+	 * @return false otherwise.
+	 */
+	bool is_inline() const noexcept
+	{
+		return this->operations && this->operations->is_inline;
+	}
+
+	property_value_base* get() const noexcept
+	{
+		return this->value;
+	}
+
+	property_value_base& operator*() const noexcept
+	{
+		ASSERT(this->value)
+		return *this->value;
+	}
+
+	property_value_base* operator->() const noexcept
+	{
+		ASSERT(this->value)
+		return this->value;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return this->value != nullptr;
+	}
+};
+
+/**
+ * @brief Create property value.
+ * The value is stored inline in the holder if it is small enough, see property_value_holder::is_stored_inline.
+ * @tparam value_type - type of the value to create.
+ * @param args - arguments of the value constructor.
+ * @return holder of the created value.
+ */
+template <typename value_type, typename... arguments_type>
+property_value_holder make_property_value(arguments_type&&... args)
+{
+	property_value_holder ret;
+	ret.emplace<value_type>(std::forward<arguments_type>(args)...);
+	return ret;
+}
+
 /**
  * @brief List of style properties corresponding to a CSS selector.
+ * The list is a vector of (property id, value) pairs sorted by property id.
+ * Rules normally declare only a few properties, so keeping those in a contiguous array
+ * makes lookups faster than in a node based map and puts all the declarations of a rule in one or a few cache lines.
+ * The interface mimics the subset of std::map interface.
+ * Property ids of the list entries must not be modified through iterators, since that would break the ordering.
  */
-using property_list = std::map<uint32_t, std::unique_ptr<property_value_base>>;
+class property_list
+{
+public:
+	using key_type = uint32_t;
+	using mapped_type = property_value_holder;
+	using value_type = std::pair<key_type, mapped_type>;
+
+private:
+	std::vector<value_type> entries;
+
+public:
+	using iterator = decltype(entries)::iterator;
+	using const_iterator = decltype(entries)::const_iterator;
+
+	iterator begin() noexcept
+	{
+		return this->entries.begin();
+	}
+
+	iterator end() noexcept
+	{
+		return this->entries.end();
+	}
+
+	const_iterator begin() const noexcept
+	{
+		return this->entries.begin();
+	}
+
+	const_iterator end() const noexcept
+	{
+		return this->entries.end();
+	}
+
+	size_t size() const noexcept
+	{
+		return this->entries.size();
+	}
+
+	bool empty() const noexcept
+	{
+		return this->entries.empty();
+	}
+
+	void clear() noexcept
+	{
+		this->entries.clear();
+	}
+
+	iterator lower_bound(key_type id) noexcept
+	{
+		return std::lower_bound(
+			this->entries.begin(), //
+			this->entries.end(),
+			id,
+			[](const value_type& e, key_type id) {
+				return e.first < id;
+			}
+		);
+	}
+
+	const_iterator lower_bound(key_type id) const noexcept
+	{
+		return std::lower_bound(
+			this->entries.begin(), //
+			this->entries.end(),
+			id,
+			[](const value_type& e, key_type id) {
+				return e.first < id;
+			}
+		);
+	}
+
+	iterator find(key_type id) noexcept
+	{
+		auto i = this->lower_bound(id);
+		if (i != this->entries.end() && i->first == id) {
+			return i;
+		}
+		return this->entries.end();
+	}
+
+	const_iterator find(key_type id) const noexcept
+	{
+		auto i = this->lower_bound(id);
+		if (i != this->entries.end() && i->first == id) {
+			return i;
+		}
+		return this->entries.end();
+	}
+
+	/**
+	 * @brief Get property value.
+	 * @param id - property id.
+	 * @return property value.
+	 * @throw std::out_of_range if there is no property with given id in the list.
+	 */
+	const mapped_type& at(key_type id) const
+	{
+		auto i = this->find(id);
+		if (i == this->entries.end()) {
+			throw std::out_of_range("property_list::at(): no property with given id");
+		}
+		return i->second;
+	}
+
+	mapped_type& at(key_type id)
+	{
+		auto i = this->find(id);
+		if (i == this->entries.end()) {
+			throw std::out_of_range("property_list::at(): no property with given id");
+		}
+		return i->second;
+	}
+
+	/**
+	 * @brief Insert property.
+	 * If the list already contains a property with same id, then the list is not changed.
+	 * @param entry - property to insert.
+	 * @return pair of iterator to the property with given id and true if the property was inserted.
+	 */
+	std::pair<iterator, bool> insert(value_type entry)
+	{
+		auto i = this->lower_bound(entry.first);
+		if (i != this->entries.end() && i->first == entry.first) {
+			return std::make_pair(i, false);
+		}
+		return std::make_pair(this->entries.insert(i, std::move(entry)), true);
+	}
+
+	/**
+	 * @brief Get property value, inserting empty value if there is no property with given id.
+	 * @param id - property id.
+	 * @return reference to the property value.
+	 */
+	mapped_type& operator[](key_type id)
+	{
+		return this->insert(value_type(id, nullptr)).first->second;
+	}
+
+	iterator erase(const_iterator i)
+	{
+		return this->entries.erase(i);
+	}
+
+	size_t erase(key_type id)
+	{
+		auto i = this->find(id);
+		if (i == this->entries.end()) {
+			return 0;
+		}
+		this->entries.erase(i);
+		return 1;
+	}
+
+	void reserve(size_t capacity)
+	{
+		this->entries.reserve(capacity);
+	}
+
+	size_t capacity() const noexcept
+	{
+		return this->entries.capacity();
+	}
+};
 
 /**
  * @brief Simple selector chain.
  */
 using selector_chain = std::vector<selector>;
 
+/**
+ * @brief Calculate specificity of a selector chain.
+ * @param selectors - selector chain to calculate specificity of.
+ * @return specificity of the selector chain.
+ */
+uint32_t calculate_specificity(const selector_chain& selectors) noexcept;
+
 struct style {
 	selector_chain selectors{};
-	std::shared_ptr<property_list> properties{};
+
+	/**
+	 * @brief Index of the style's property list in the sheet::property_lists of the sheet owning the style.
+	 * Several styles can refer to the same property list, e.g. comma separated selector chains
+	 * defined with a common set of properties.
+	 */
+	size_t properties_index = 0;
 
 	uint32_t specificity{};
 
 	void update_specificity() noexcept;
 
 	bool is_matching(xml_dom_crawler& crawler) const;
+
+	/**
+	 * @brief Get selector text of the style.
+	 * @return selector chain of the style as it would appear in a CSS file.
+	 */
+	std::string get_name() const;
+};
+
+/**
+ * @brief Set of features observed in a corpus of documents.
+ * Used to purge the styles which cannot match any node of the corpus, see sheet::purge_unused().
+ */
+struct document_features {
+	std::set<std::string, std::less<>> tags;
+	std::set<std::string, std::less<>> ids;
+	std::set<std::string, std::less<>> classes;
+
+	/**
+	 * @brief Add features of a node.
+	 * @param node - node to add features of.
+	 */
+	void add(const styleable& node);
+
+	/**
+	 * @brief Check if a node with the selector's features can be present in the corpus.
+	 * Only tags, ids and classes are taken into account, all other parts of the selector are assumed to be possibly
+	 * matching.
+	 * @param sel - selector to check.
+	 * @return true if the selector can possibly match some node of the corpus.
+	 * @return false if the selector cannot match any node of the corpus.
+	 */
+	bool can_match(const selector& sel) const;
+};
+
+/**
+ * @brief Environment to evaluate media conditions against.
+ */
+struct media_environment {
+	/**
+	 * @brief Viewport width in CSS pixels.
+	 */
+	double width = 0;
+
+	/**
+	 * @brief Viewport height in CSS pixels.
+	 */
+	double height = 0;
+
+	/**
+	 * @brief Resolution in dots per inch.
+	 * 96 dpi corresponds to one device pixel per CSS pixel.
+	 */
+	double dpi = 96; // NOLINT(cppcoreguidelines-avoid-magic-numbers, "CSS reference resolution")
+
+	/**
+	 * @brief Media types and other features present in the environment.
+	 * Contains media type names, e.g. "screen", names of boolean features, e.g. "hover",
+	 * and values of discrete features in the "name:value" form, e.g. "prefers-color-scheme:dark".
+	 */
+	std::set<std::string, std::less<>> features;
+};
+
+enum class media_feature_type {
+	/**
+	 * @brief Media type or feature which is looked up in media_environment::features.
+	 */
+	named,
+	width,
+	height,
+	resolution,
+	portrait,
+	landscape
+};
+
+/**
+ * @brief Single media feature test, e.g. "(min-width: 600px)" or "screen".
+ */
+struct media_expression {
+	media_feature_type type = media_feature_type::named;
+
+	/**
+	 * @brief Name of the named feature, as it appears in media_environment::features.
+	 */
+	std::string name;
+
+	/**
+	 * @brief Range of the width, height or resolution feature.
+	 * Inclusive. Width and height are in CSS pixels, resolution is in dots per inch.
+	 */
+	double min = -std::numeric_limits<double>::infinity();
+	double max = std::numeric_limits<double>::infinity();
+
+	bool is_active(const media_environment& env) const;
+};
+
+/**
+ * @brief Media query.
+ * The query is true if all its expressions are true, or, if the query is negated, if any of those is false.
+ */
+struct media_query {
+	bool negated = false;
+	std::vector<media_expression> expressions;
+
+	bool is_active(const media_environment& env) const;
+};
+
+/**
+ * @brief Media condition of a @media block.
+ * Comma separated list of media queries, the condition is true if any of the queries is true.
+ */
+struct media_condition {
+	/**
+	 * @brief Text of the condition as it appears in the CSS file.
+	 */
+	std::string text;
+
+	std::vector<media_query> queries;
+
+	/**
+	 * @brief Check if the condition is true in given environment.
+	 * Empty condition is always true.
+	 * @param env - environment to check the condition in.
+	 * @return true if the condition is true in given environment.
+	 */
+	bool is_active(const media_environment& env) const;
+};
+
+/**
+ * @brief Parse media condition.
+ * Supported media features are width, height and resolution, with min- and max- prefixes, and orientation.
+ * Other media types and features are looked up in media_environment::features.
+ * @param text - condition text, i.e. the text between @media and the opening curly brace.
+ * @return parsed media condition.
+ * @throw malformed_css_error if the condition is malformed.
+ */
+media_condition parse_media_condition(std::string_view text);
+
+/**
+ * @brief Parse media condition without throwing.
+ * Same as parse_media_condition(std::string_view), but reports malformed condition through the return value.
+ * @param text - condition text, i.e. the text between @media and the opening curly brace.
+ * @param error - receives the error message if the condition is malformed.
+ * @return parsed media condition.
+ * @return std::nullopt if the condition is malformed.
+ */
+std::optional<media_condition> parse_media_condition(std::string_view text, std::string& error);
+
+/**
+ * @brief Styles of a @media block.
+ */
+struct media_block {
+	media_condition condition;
+
+	/**
+	 * @brief Styles of the block.
+	 * Sorted by specificity, same as sheet::styles.
+	 * The styles refer to the property lists of the sheet owning the block.
+	 */
+	std::vector<style> styles;
 };
 
 struct sheet {
 	std::vector<style> styles{};
 
+	/**
+	 * @brief Conditional partitions of the sheet, in the order of their appearance in the CSS file.
+	 * The styles of the media blocks do not take part in the sheet queries, to query those
+	 * use media_sheet which makes views of the sheet for a particular media environment.
+	 * The optimize() does not touch the media blocks.
+	 */
+	std::vector<media_block> media_blocks{};
+
+	/**
+	 * @brief Pool of property lists referred by the styles.
+	 * The property lists are owned by the sheet and styles refer to those by index,
+	 * so that moving styles around does not touch the property lists.
+	 * The property lists go in the source order of the rules which define them,
+	 * media_view relies on that to merge media block styles with unconditional styles.
+	 */
+	std::vector<property_list> property_lists{};
+
+	/**
+	 * @brief Get property list of a style.
+	 * @param s - style of this sheet.
+	 * @return property list of the style.
+	 */
+	const property_list& get_properties(const style& s) const noexcept
+	{
+		ASSERT(s.properties_index < this->property_lists.size())
+		return this->property_lists[s.properties_index];
+	}
+
+	property_list& get_properties(const style& s) noexcept
+	{
+		ASSERT(s.properties_index < this->property_lists.size())
+		return this->property_lists[s.properties_index];
+	}
+
+	/**
+	 * @brief Add property list to the pool.
+	 * @param properties - property list to add.
+	 * @return index of the added property list, to be assigned to style::properties_index.
+	 */
+	size_t add_property_list(property_list properties)
+	{
+		this->property_lists.push_back(std::move(properties));
+		return this->property_lists.size() - 1;
+	}
+
+	/**
+	 * @brief Remove property lists not referred by any style.
+	 * Styles of the media blocks are taken into account.
+	 * The remaining property lists keep their relative order, the styles are updated to refer to their new indices.
+	 */
+	void remove_unused_property_lists();
+
 	void write(
 		fsif::file& fi,
 		const std::function<std::string(uint32_t)>& property_id_to_name,
@@ -160,10 +1111,118 @@ struct sheet {
 		std::string_view indent = {}
 	) const;
 
+	struct write_options {
+		/**
+		 * @brief Indentation to prepend to each output line.
+		 * Ignored in minified mode.
+		 */
+		std::string_view indent;
+
+		/**
+		 * @brief Minified output.
+		 * No indentation and no optional whitespace is output.
+		 */
+		bool minify = false;
+
+		/**
+		 * @brief Sort rules to produce deterministic output.
+		 * If false, the rules are output in the source order, i.e. reading the output back
+		 * gives the same precedence of the rules, and the output is faster.
+		 */
+		bool sort = true;
+	};
+
+	/**
+	 * @brief Write the sheet to a file.
+	 * The output is formatted into a buffer which is flushed to the file in large blocks.
+	 * Selector chains referring to the same property list are merged into a single comma-separated selector group.
+	 * @param fi - file to write to.
+	 * @param property_id_to_name - function returning property name by id.
+	 *                              If it returns empty string, the property is not written.
+	 * @param property_value_to_string - function converting property value to string.
+	 * @param options - output options.
+	 */
+	void write(
+		fsif::file& fi,
+		const std::function<std::string(uint32_t)>& property_id_to_name,
+		const std::function<std::string(uint32_t, const property_value_base&)>& property_value_to_string,
+		const write_options& options
+	) const;
+
+	/**
+	 * @brief Sort styles by specificity.
+	 * Styles are sorted in descending order of their specificity.
+	 * The sort is stable, i.e. styles of equal specificity keep their relative order,
+	 * the one which goes first takes precedence over the following ones.
+	 * Styles of the media blocks are sorted as well.
+	 */
 	void sort_styles_by_specificity();
 
+	/**
+	 * @brief Append another sheet to this one.
+	 * Both sheets are expected to be sorted by specificity, which is the case for sheets
+	 * returned by cssom::read(). The styles are merged in linear time, no re-sorting is done.
+	 * Styles of the appended sheet take precedence over styles of equal specificity of this sheet.
+	 * The property lists of the appended sheet are moved to the end of this sheet's pool.
+	 * The media blocks of the appended sheet are added after the media blocks of this sheet.
+	 * @param d - sheet to append.
+	 */
 	void append(sheet d);
 
+	/**
+	 * @brief Insert style.
+	 * The position for the style is found with binary search by specificity, so no re-sorting is needed.
+	 * The inserted style takes precedence over the styles of equal specificity,
+	 * as if it was the last one in the source.
+	 * The style's specificity must be up to date, see style::update_specificity().
+	 * The style must refer to a property list of this sheet, see add_property_list().
+	 * @param s - style to insert.
+	 * @return index of the inserted style.
+	 */
+	size_t insert_style(style s);
+
+	/**
+	 * @brief Remove styles with given selector chain.
+	 * The styles of the same specificity as the given selector chain are found with binary search,
+	 * then among those the ones with the given selector chain are removed.
+	 * The property lists of the removed styles are kept in the pool, see remove_unused_property_lists().
+	 * The removed styles are returned, so that the caller can update data derived from the sheet,
+	 * e.g. call invalidation_map::remove() for each of them.
+	 * @param selectors - selector chain of the styles to remove.
+	 * @return removed styles, in the order they were in the sheet.
+	 */
+	std::vector<style> remove_style(const selector_chain& selectors);
+
+	/**
+	 * @brief Optimize the sheet.
+	 * Reduces number of styles and declarations without changing query results:
+	 * - removes declarations overridden by a style of higher precedence with the same selector chain;
+	 * - merges styles with the same selector chain into one, when no style in between could interfere;
+	 * - removes styles with empty property lists;
+	 * - makes styles with equal property lists share the same property list,
+	 *   if values comparison function is given;
+	 * - removes property lists which are no longer referred by any style.
+	 * Property lists which are shared by comma separated selector group members are never modified.
+	 * If the sheet has media blocks, the styles are not merged and the property lists are not shared,
+	 * since the order of the property lists defines the source order of the styles, see media_view.
+	 * @param are_values_equal - function comparing two values of a property with given id.
+	 *                           Can be nullptr, in which case property lists are not shared.
+	 */
+	void optimize(
+		const std::function<bool(uint32_t, const property_value_base&, const property_value_base&)>&
+			are_values_equal = nullptr
+	);
+
+	/**
+	 * @brief Get sheet without styles which cannot match any node of a corpus of documents.
+	 * A style is kept only if each selector of its selector chain can possibly match some node of the corpus.
+	 * Styles of the media blocks are purged as well.
+	 * The resulting sheet has no property lists which are not referred by any of its styles.
+	 * @param features - features of the corpus of documents.
+	 * @return sheet with unused styles removed.
+	 */
+	sheet purge_unused(const document_features& features) const;
+
 	struct query_result {
 		/**
 		 * @brief Value of the queried property.
@@ -186,12 +1245,148 @@ struct sheet {
 	 * property.
 	 */
 	query_result get_property_value(xml_dom_crawler& crawler, uint32_t property_id) const;
+
+	/**
+	 * @brief Get values of several properties for given xml document node.
+	 * Gives same results as calling get_property_value() for each property id, but each style is matched
+	 * at most once. Styles which do not define any of the still unresolved properties are not matched at all.
+	 * The search stops as soon as all the properties are resolved.
+	 * @param crawler - crawler pointing to the node to get the property values for.
+	 * @param property_ids - ids of the properties to get.
+	 * @param out - query results, one for each property id, in the same order as property ids.
+	 *              Must have same size as property_ids.
+	 * @return number of resolved properties, i.e. the ones which have non-nullptr value in the query result.
+	 */
+	size_t get_property_values(
+		xml_dom_crawler& crawler,
+		utki::span<const uint32_t> property_ids,
+		utki::span<query_result> out
+	) const;
+
+	/**
+	 * @brief Heap memory used by a sheet, in bytes.
+	 * Memory of arrays is accounted by their capacity.
+	 */
+	struct memory_usage_report {
+		/**
+		 * @brief Arrays of styles, including styles of the media blocks.
+		 */
+		size_t styles = 0;
+
+		/**
+		 * @brief Arrays of selectors and arrays of classes, attribute selectors and pseudo-classes of those.
+		 */
+		size_t selectors = 0;
+
+		/**
+		 * @brief Selector strings which do not fit into the small string buffer.
+		 * Interned strings, see cssom::intern(), are shared process-wide, so those are not accounted.
+		 */
+		size_t selector_strings = 0;
+
+		/**
+		 * @brief Media conditions of the media blocks.
+		 */
+		size_t media_conditions = 0;
+
+		/**
+		 * @brief Property list pool and entries of the property lists.
+		 * Includes the values stored inline in the entries.
+		 */
+		size_t property_lists = 0;
+
+		/**
+		 * @brief Property values, as reported by the value size function.
+		 */
+		size_t property_values = 0;
+
+		/**
+		 * @brief Property lists and values referred by more than one style.
+		 * Part of property_lists and property_values.
+		 */
+		size_t shared_property_lists = 0;
+
+		/**
+		 * @brief Property lists and values referred by exactly one style.
+		 * Part of property_lists and property_values.
+		 */
+		size_t unique_property_lists = 0;
+
+		size_t num_property_lists = 0;
+		size_t num_shared_property_lists = 0;
+
+		/**
+		 * @brief Number of property lists not referred by any style.
+		 * See remove_unused_property_lists().
+		 */
+		size_t num_unused_property_lists = 0;
+
+		size_t num_property_values = 0;
+		size_t num_inline_property_values = 0;
+
+		size_t get_total() const noexcept
+		{
+			return this->styles + this->selectors + this->selector_strings + this->media_conditions +
+				this->property_lists + this->property_values;
+		}
+	};
+
+	/**
+	 * @brief Get memory usage of the sheet.
+	 * Takes linear time of the sheet size.
+	 * @param value_size - function returning number of heap bytes used by a property value:
+	 *                     the value object itself, if it is not stored inline, see property_value_holder::is_inline(),
+	 *                     plus the memory owned by the value. Can be nullptr, in which case property values
+	 *                     are not accounted, except the ones stored inline.
+	 * @return memory usage report.
+	 */
+	memory_usage_report memory_usage(
+		const std::function<size_t(uint32_t, const property_value_holder&)>& value_size = nullptr
+	) const;
 };
 
 sheet read(
 	const fsif::file& fi,
 	std::function<uint32_t(std::string_view)> property_name_to_id,
-	std::function<std::unique_ptr<property_value_base>(uint32_t, std::string_view)> parse_property_value
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property_value
+);
+
+/**
+ * @brief Read CSS file in error recovery mode.
+ * Same as cssom::read(), but malformed rules are skipped instead of throwing malformed_css_error,
+ * see parser::set_error_recovery().
+ * @param fi - file to read.
+ * @param property_name_to_id - function returning property id by its name.
+ * @param parse_property_value - function parsing property value.
+ * @param errors - receives the errors encountered while parsing.
+ * @return the sheet of the well-formed rules.
+ */
+sheet read(
+	const fsif::file& fi,
+	std::function<uint32_t(std::string_view)> property_name_to_id,
+	std::function<property_value_holder(uint32_t, std::string_view)> parse_property_value,
+	std::vector<parse_error>& errors
+);
+
+/**
+ * @brief Read several CSS files concurrently.
+ * The files are read and parsed in parallel by a pool of threads, then merged into one sheet with a single
+ * specificity sort. The result is same as of reading concatenation of the files in the given order,
+ * i.e. styles of later files take precedence over styles of equal specificity of earlier files.
+ * @param files - files to read.
+ * @param property_name_to_id - function returning property id by its name.
+ *                              Called concurrently from several threads.
+ * @param parse_property_value - function parsing property value. Called concurrently from several threads.
+ * @param num_threads - maximum number of threads to use, including the calling thread.
+ *                      0 means the number of hardware threads.
+ * @return the merged sheet.
+ * @throw the exception thrown while reading the first failed file, in the order of files.
+ */
+sheet read(
+	utki::span<const fsif::file* const> files,
+	const std::function<uint32_t(std::string_view)>& property_name_to_id,
+	const std::function<property_value_holder(uint32_t, std::string_view)>& parse_property_value,
+	unsigned num_threads = 0
 );
 
 } // namespace cssom
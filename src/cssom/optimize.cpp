@@ -0,0 +1,260 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <utki/debug.hpp>
+
+#include "om.hpp"
+
+using namespace cssom;
+
+namespace {
+void hash_combine(size_t& seed, size_t value) noexcept
+{
+	// same as boost::hash_combine()
+	constexpr auto magic = 0x9e3779b9;
+	constexpr auto shift_left = 6;
+	constexpr auto shift_right = 2;
+	seed ^= value + magic + (seed << shift_left) + (seed >> shift_right);
+}
+} // namespace
+
+namespace {
+struct selector_chain_hash {
+	size_t operator()(const selector_chain* chain) const noexcept
+	{
+		std::hash<std::string_view> h;
+		size_t ret = chain->size();
+		for (const auto& s : *chain) {
+			hash_combine(ret, h(s.tag));
+			hash_combine(ret, h(s.id));
+			for (const auto& c : s.classes) {
+				hash_combine(ret, h(c));
+			}
+			for (const auto& a : s.attributes) {
+				hash_combine(ret, h(a.name));
+				hash_combine(ret, h(a.value));
+			}
+			for (const auto& pc : s.pseudo_classes) {
+				hash_combine(ret, h(pc.name));
+			}
+			hash_combine(ret, size_t(s.combinator));
+		}
+		return ret;
+	}
+};
+} // namespace
+
+namespace {
+struct selector_chain_equal {
+	bool operator()(const selector_chain* a, const selector_chain* b) const noexcept
+	{
+		return *a == *b;
+	}
+};
+} // namespace
+
+namespace {
+// Removes overridden declarations and merges styles with same selector chains.
+// Merging moves declarations to a later position in the source order, so it is only done if can_merge_styles is true.
+// Returns flags of styles which have been merged into other styles and are to be removed.
+std::vector<bool> merge_same_selector_chains(
+	std::vector<style>& styles,
+	std::vector<property_list>& property_lists,
+	bool can_merge_styles
+)
+{
+	// Number of styles referring to each property list.
+	// The list can be shared by other styles of the same selector group, such lists are never modified.
+	std::vector<size_t> ref_counts(property_lists.size(), 0);
+	for (const auto& s : styles) {
+		ASSERT(s.properties_index < ref_counts.size())
+		++ref_counts[s.properties_index];
+	}
+
+	auto is_shared = [&ref_counts](size_t properties_index) {
+		return ref_counts[properties_index] != 1;
+	};
+
+	std::vector<bool> merged(styles.size(), false);
+
+	// index of first, i.e. the highest precedence, style for each selector chain
+	std::unordered_map<const selector_chain*, size_t, selector_chain_hash, selector_chain_equal> chains;
+
+	for (size_t i = 0; i != styles.size(); ++i) {
+		auto& s = styles[i];
+
+		auto res = chains.insert(std::make_pair(&s.selectors, i));
+		if (res.second) {
+			continue;
+		}
+
+		auto& top = styles[res.first->second];
+		ASSERT(top.specificity == s.specificity)
+
+		if (top.properties_index == s.properties_index) {
+			// duplicate style, it can never win
+			merged[i] = true;
+			--ref_counts[s.properties_index];
+			continue;
+		}
+
+		if (is_shared(s.properties_index)) {
+			continue;
+		}
+
+		auto& props = property_lists[s.properties_index];
+		auto& top_props = property_lists[top.properties_index];
+
+		// Declarations of the lower precedence style which are also present in the higher precedence style
+		// with the same selector chain can never win, remove those.
+		for (auto j = props.begin(); j != props.end();) {
+			if (top_props.find(j->first) != top_props.end()) {
+				j = props.erase(j);
+			} else {
+				++j;
+			}
+		}
+
+		if (props.empty() || is_shared(top.properties_index) || !can_merge_styles) {
+			continue;
+		}
+
+		// Moving the declarations up to the higher precedence style is only possible if none of the
+		// styles in between, which are all of the same specificity, declares any of the moved properties.
+		bool can_merge = std::none_of(
+			std::next(styles.begin(), std::ptrdiff_t(res.first->second + 1)),
+			std::next(styles.begin(), std::ptrdiff_t(i)),
+			[&props, &property_lists](const auto& st) {
+				const auto& st_props = property_lists[st.properties_index];
+				return std::any_of(props.begin(), props.end(), [&st_props](const auto& p) {
+					return st_props.find(p.first) != st_props.end();
+				});
+			}
+		);
+
+		if (!can_merge) {
+			continue;
+		}
+
+		for (auto& p : props) {
+			top_props.insert(std::move(p));
+		}
+		props.clear();
+		merged[i] = true;
+		--ref_counts[s.properties_index];
+	}
+
+	return merged;
+}
+} // namespace
+
+namespace {
+void share_equal_property_lists(
+	std::vector<style>& styles,
+	const std::vector<property_list>& property_lists,
+	const std::function<bool(uint32_t, const property_value_base&, const property_value_base&)>& are_values_equal
+)
+{
+	auto are_lists_equal = [&are_values_equal](const property_list& a, const property_list& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j) {
+			ASSERT(j != b.end())
+			if (i->first != j->first) {
+				return false;
+			}
+			if (!are_values_equal(i->first, *i->second, *j->second)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// bucket property lists by their property ids, so that only the lists with same set of properties are compared
+	auto hash_ids = [](const property_list& l) {
+		size_t ret = l.size();
+		for (const auto& p : l) {
+			hash_combine(ret, p.first);
+		}
+		return ret;
+	};
+
+	// property list hash to index of the canonical property list
+	std::unordered_multimap<size_t, size_t> canonical;
+
+	for (auto& s : styles) {
+		const auto& props = property_lists[s.properties_index];
+
+		auto hash = hash_ids(props);
+
+		auto range = canonical.equal_range(hash);
+		auto i = std::find_if(range.first, range.second, [&](const auto& c) {
+			return c.second == s.properties_index || are_lists_equal(property_lists[c.second], props);
+		});
+
+		if (i == range.second) {
+			canonical.insert(std::make_pair(hash, s.properties_index));
+		} else {
+			s.properties_index = i->second;
+		}
+	}
+}
+} // namespace
+
+void sheet::optimize(
+	const std::function<bool(uint32_t, const property_value_base&, const property_value_base&)>& are_values_equal
+)
+{
+	// The order of property lists defines the source order of the styles, which is needed to merge
+	// media block styles with unconditional styles, see media_view. Merging styles and sharing property lists
+	// would change that order, so those are not done if the sheet has media blocks.
+	bool keep_source_order = !this->media_blocks.empty();
+
+	auto merged = merge_same_selector_chains(this->styles, this->property_lists, !keep_source_order);
+
+	size_t num_kept = 0;
+	for (size_t i = 0; i != this->styles.size(); ++i) {
+		if (merged[i] || this->get_properties(this->styles[i]).empty()) {
+			continue;
+		}
+		if (i != num_kept) {
+			this->styles[num_kept] = std::move(this->styles[i]);
+		}
+		++num_kept;
+	}
+	this->styles.resize(num_kept);
+
+	if (are_values_equal && !keep_source_order) {
+		share_equal_property_lists(this->styles, this->property_lists, are_values_equal);
+	}
+
+	this->remove_unused_property_lists();
+}
@@ -26,6 +26,7 @@ SOFTWARE.
 
 #include "parser.hpp"
 
+#include <algorithm>
 #include <sstream>
 
 #include <utki/string.hpp>
@@ -55,6 +56,15 @@ void parser::feed(utki::span<const char> data)
 			case state::selector_class:
 				this->parse_selector_class(i, e);
 				break;
+			case state::selector_attribute:
+				this->parse_selector_attribute(i, e);
+				break;
+			case state::selector_pseudo_class:
+				this->parse_selector_pseudo_class(i, e);
+				break;
+			case state::simple_selector_end:
+				this->parse_simple_selector_end(i, e);
+				break;
 			case state::combinator:
 				this->parse_combinator(i, e);
 				break;
@@ -67,10 +77,119 @@ void parser::feed(utki::span<const char> data)
 			case state::property_value:
 				this->parse_property_value(i, e);
 				break;
+			case state::at_rule:
+				this->parse_at_rule(i, e);
+				break;
+			case state::skipped_rule:
+				this->parse_skipped_rule(i, e);
+				break;
 		}
 		if (i == e) {
 			return;
 		}
+		if (this->failed) {
+			this->recover(*i);
+		}
+	}
+}
+
+void parser::fail(std::string message)
+{
+	if (!this->error_recovery) {
+		throw malformed_css_error(message);
+	}
+
+	if (this->failed) {
+		// only the first error of the rule is reported
+		return;
+	}
+
+	this->failed = true;
+	this->error_message = std::move(message);
+}
+
+void parser::recover(char c)
+{
+	ASSERT(this->failed)
+
+	this->failed = false;
+
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	this->on_error(parse_error{this->line, std::move(this->error_message)});
+	this->error_message.clear();
+
+	this->buf.clear();
+	this->attribute_quote = 0;
+	this->pseudo_class_paren_depth = 0;
+
+	// c is the last processed character, the state is the one after processing it
+	switch (this->cur_state) {
+		case state::style_idle:
+		case state::property_name:
+		case state::property_value_delimiter:
+		case state::property_value:
+			// inside of the style block
+			if (c == '}') {
+				// the block is closed by the character which caused the error
+				this->cur_state = state::idle;
+				return;
+			}
+			this->skipped_rule_brace_depth = 1;
+			break;
+		case state::at_rule:
+			if (c == ';') {
+				// statement at-rule, nothing else to skip
+				this->cur_state = state::idle;
+				return;
+			}
+			[[fallthrough]];
+		default:
+			// inside of the selector or at-rule prelude
+			if (c == '}') {
+				this->end_skipped_rule();
+				return;
+			}
+			this->skipped_rule_brace_depth = c == '{' ? 1 : 0;
+			break;
+	}
+
+	this->cur_state = state::skipped_rule;
+}
+
+void parser::end_skipped_rule()
+{
+	// closing curly brace encountered outside of any block of the skipped rule
+	if (this->inside_media_block) {
+		this->inside_media_block = false;
+		this->on_media_end();
+	}
+	this->cur_state = state::idle;
+}
+
+void parser::parse_skipped_rule(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
+{
+	for (; i != e; ++i) {
+		switch (*i) {
+			case '\n':
+				++this->line;
+				break;
+			case '{':
+				++this->skipped_rule_brace_depth;
+				break;
+			case '}':
+				if (this->skipped_rule_brace_depth == 0) {
+					this->end_skipped_rule();
+					return;
+				}
+				--this->skipped_rule_brace_depth;
+				if (this->skipped_rule_brace_depth == 0) {
+					this->cur_state = state::idle;
+					return;
+				}
+				break;
+			default:
+				break;
+		}
 	}
 }
 
@@ -92,7 +211,23 @@ void parser::parse_idle(utki::span<const char>::iterator& i, utki::span<const ch
 				this->cur_state = state::selector_id;
 				return;
 			case '[':
-				throw std::runtime_error("parsing of attribute selectors is not implemented");
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				this->cur_state = state::selector_pseudo_class;
+				return;
+			case '@':
+				this->cur_state = state::at_rule;
+				return;
+			case '}':
+				if (!this->inside_media_block) {
+					std::stringstream ss;
+					ss << "unexpected } encountered at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+				this->inside_media_block = false;
+				this->on_media_end();
 				break;
 			default:
 				this->buf.push_back(*i);
@@ -166,8 +301,15 @@ void parser::parse_selector_tag(utki::span<const char>::iterator& i, utki::span<
 				this->cur_state = state::selector_id;
 				return;
 			case '[':
-				throw std::runtime_error("parsing of attribute selectors is not implemented");
-				break;
+				this->on_selector_tag(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				this->on_selector_tag(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_pseudo_class;
+				return;
 			default:
 				this->buf.push_back(*i);
 				break;
@@ -213,11 +355,19 @@ void parser::parse_selector_id(utki::span<const char>::iterator& i, utki::span<c
 				{
 					std::stringstream ss;
 					ss << "unexpected # encountered at line " << this->line;
-					throw malformed_css_error(ss.str());
+					this->fail(ss.str());
+					return;
 				}
 			case '[':
-				throw std::runtime_error("parsing of attribute selectors is not implemented");
-				break;
+				this->on_selector_id(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				this->on_selector_id(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_pseudo_class;
+				return;
 			default:
 				this->buf.push_back(*i);
 				break;
@@ -249,8 +399,15 @@ void parser::parse_selector_class(utki::span<const char>::iterator& i, utki::spa
 				this->buf.clear();
 				break;
 			case '[':
-				throw std::runtime_error("parsing of attribute selectors is not implemented");
-				break;
+				this->on_selector_class(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				this->on_selector_class(utki::make_string(utki::make_span(this->buf)));
+				this->buf.clear();
+				this->cur_state = state::selector_pseudo_class;
+				return;
 			case '#':
 				this->on_selector_tag(utki::make_string(utki::make_span(this->buf)));
 				this->buf.clear();
@@ -273,6 +430,282 @@ void parser::parse_selector_class(utki::span<const char>::iterator& i, utki::spa
 	}
 }
 
+namespace {
+bool is_attribute_operation_char(char c)
+{
+	switch (c) {
+		case '=':
+		case '~':
+		case '|':
+		case '^':
+		case '$':
+		case '*':
+			return true;
+		default:
+			return false;
+	}
+}
+} // namespace
+
+bool parser::notify_selector_attribute()
+{
+	// attribute selector contents is: name [operation value]
+	auto str = utki::trim(utki::make_string_view(this->buf));
+
+	auto malformed = [this, &str]() {
+		std::stringstream ss;
+		ss << "malformed attribute selector [" << str << "] at line " << this->line;
+		this->fail(ss.str());
+	};
+
+	auto name_end = std::find_if(str.begin(), str.end(), [](char c) {
+		return is_attribute_operation_char(c) || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	});
+
+	std::string name(str.begin(), name_end);
+	if (name.empty()) {
+		malformed();
+		return false;
+	}
+
+	auto rest = utki::trim_front(str.substr(name.size()));
+
+	auto op_end = std::find_if_not(rest.begin(), rest.end(), [](char c) {
+		return is_attribute_operation_char(c);
+	});
+
+	std::string operation(rest.begin(), op_end);
+
+	auto value = utki::trim_front(rest.substr(operation.size()));
+
+	if (operation.empty()) {
+		if (!value.empty()) {
+			malformed();
+			return false;
+		}
+	} else if (operation != "=" && operation.size() != 2) {
+		malformed();
+		return false;
+	} else if (operation.size() == 2 && operation.back() != '=') {
+		malformed();
+		return false;
+	}
+
+	if (!value.empty() && (value.front() == '"' || value.front() == '\'')) {
+		if (value.size() < 2 || value.back() != value.front()) {
+			malformed();
+			return false;
+		}
+		value = value.substr(1, value.size() - 2);
+	}
+
+	this->on_selector_attribute(std::move(name), std::move(operation), std::string(value));
+	this->buf.clear();
+	return true;
+}
+
+void parser::parse_selector_attribute(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
+{
+	for (; i != e; ++i) {
+		if (this->attribute_quote != 0) {
+			if (*i == this->attribute_quote) {
+				this->attribute_quote = 0;
+			}
+			this->buf.push_back(*i);
+			continue;
+		}
+
+		switch (*i) {
+			case '\n':
+				++this->line;
+				this->buf.push_back(*i);
+				break;
+			case '"':
+			case '\'':
+				this->attribute_quote = *i;
+				this->buf.push_back(*i);
+				break;
+			case ']':
+				if (!this->notify_selector_attribute()) {
+					return;
+				}
+				this->cur_state = state::simple_selector_end;
+				return;
+			case '[':
+			case '{':
+			case '}':
+				{
+					std::stringstream ss;
+					ss << "unexpected " << *i << " inside of attribute selector at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+			default:
+				this->buf.push_back(*i);
+				break;
+		}
+	}
+}
+
+void parser::notify_selector_pseudo_class()
+{
+	auto str = utki::make_string_view(this->buf);
+
+	auto paren_pos = str.find('(');
+	if (paren_pos == std::string_view::npos) {
+		this->on_selector_pseudo_class(std::string(str), std::string());
+	} else {
+		ASSERT(str.back() == ')')
+		auto arg = str.substr(paren_pos + 1, str.size() - paren_pos - 2);
+		this->on_selector_pseudo_class(std::string(str.substr(0, paren_pos)), std::string(utki::trim(arg)));
+	}
+	this->buf.clear();
+}
+
+void parser::parse_selector_pseudo_class(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
+{
+	for (; i != e; ++i) {
+		if (this->pseudo_class_paren_depth != 0) {
+			switch (*i) {
+				case '\n':
+					++this->line;
+					break;
+				case '(':
+					++this->pseudo_class_paren_depth;
+					break;
+				case ')':
+					--this->pseudo_class_paren_depth;
+					break;
+				case '{':
+				case '}':
+					{
+						std::stringstream ss;
+						ss << "unexpected " << *i << " inside of pseudo-class argument at line " << this->line;
+						this->fail(ss.str());
+						return;
+					}
+				default:
+					break;
+			}
+
+			this->buf.push_back(*i);
+
+			if (this->pseudo_class_paren_depth == 0) {
+				this->notify_selector_pseudo_class();
+				this->cur_state = state::simple_selector_end;
+				return;
+			}
+			continue;
+		}
+
+		switch (*i) {
+			case '\n':
+				++this->line;
+			case ' ':
+			case '\r':
+			case '\t':
+				this->notify_selector_pseudo_class();
+				this->on_selector_end();
+				this->cur_state = state::combinator;
+				return;
+			case '{':
+				this->notify_selector_pseudo_class();
+				this->on_selector_end();
+				this->on_selector_chain_end();
+				this->cur_state = state::style_idle;
+				return;
+			case ',':
+				this->notify_selector_pseudo_class();
+				this->on_selector_end();
+				this->on_selector_chain_end();
+				this->cur_state = state::idle;
+				return;
+			case '.':
+				this->notify_selector_pseudo_class();
+				this->cur_state = state::selector_class;
+				return;
+			case '#':
+				this->notify_selector_pseudo_class();
+				this->cur_state = state::selector_id;
+				return;
+			case '[':
+				this->notify_selector_pseudo_class();
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				if (this->buf.empty()) {
+					// pseudo-element, i.e. '::'
+					this->buf.push_back(*i);
+					break;
+				}
+				this->notify_selector_pseudo_class();
+				if (this->failed) {
+					return;
+				}
+				break;
+			case '(':
+				if (this->buf.empty()) {
+					std::stringstream ss;
+					ss << "pseudo-class name expected before '(' at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+				++this->pseudo_class_paren_depth;
+				this->buf.push_back(*i);
+				break;
+			default:
+				this->buf.push_back(*i);
+				break;
+		}
+	}
+}
+
+void parser::parse_simple_selector_end(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
+{
+	for (; i != e; ++i) {
+		ASSERT(this->buf.empty())
+		switch (*i) {
+			case '\n':
+				++this->line;
+			case ' ':
+			case '\r':
+			case '\t':
+				this->on_selector_end();
+				this->cur_state = state::combinator;
+				return;
+			case '{':
+				this->on_selector_end();
+				this->on_selector_chain_end();
+				this->cur_state = state::style_idle;
+				return;
+			case ',':
+				this->on_selector_end();
+				this->on_selector_chain_end();
+				this->cur_state = state::idle;
+				return;
+			case '.':
+				this->cur_state = state::selector_class;
+				return;
+			case '#':
+				this->cur_state = state::selector_id;
+				return;
+			case '[':
+				this->cur_state = state::selector_attribute;
+				return;
+			case ':':
+				this->cur_state = state::selector_pseudo_class;
+				return;
+			default:
+				{
+					std::stringstream ss;
+					ss << "unexpected character after attribute selector or pseudo-class at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+		}
+	}
+}
+
 void parser::parse_combinator(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
 {
 	for (; i != e; ++i) {
@@ -296,7 +729,8 @@ void parser::parse_combinator(utki::span<const char>::iterator& i, utki::span<co
 					std::stringstream ss;
 					ss << "unknown combinator encountered (" << utki::make_string(utki::make_span(this->buf)) << *i
 					   << ") at line " << this->line;
-					throw malformed_css_error(ss.str());
+					this->fail(ss.str());
+					return;
 				}
 				this->buf.push_back(*i);
 				break;
@@ -305,7 +739,8 @@ void parser::parse_combinator(utki::span<const char>::iterator& i, utki::span<co
 					std::stringstream ss;
 					ss << "unexpected combinator encountered (" << utki::make_string(utki::make_span(this->buf))
 					   << ") at line " << this->line;
-					throw malformed_css_error(ss.str());
+					this->fail(ss.str());
+					return;
 				}
 				this->on_selector_chain_end();
 				this->cur_state = state::style_idle;
@@ -315,7 +750,8 @@ void parser::parse_combinator(utki::span<const char>::iterator& i, utki::span<co
 					std::stringstream ss;
 					ss << "unexpected combinator encountered (" << utki::make_string(utki::make_span(this->buf))
 					   << ") at line " << this->line;
-					throw malformed_css_error(ss.str());
+					this->fail(ss.str());
+					return;
 				}
 				this->on_selector_chain_end();
 				this->cur_state = state::idle;
@@ -329,13 +765,10 @@ void parser::parse_combinator(utki::span<const char>::iterator& i, utki::span<co
 						this->cur_state = state::selector_class;
 						break;
 					case '[':
-						utki::assert(
-							false,
-							[](auto& o) {
-								o << "attribute selectors are not implemented";
-							},
-							SL
-						);
+						this->cur_state = state::selector_attribute;
+						break;
+					case ':':
+						this->cur_state = state::selector_pseudo_class;
 						break;
 					default:
 						this->buf.push_back(*i);
@@ -393,7 +826,8 @@ void parser::parse_property_value_delimiter(utki::span<const char>::iterator& i,
 			default:
 				std::stringstream ss;
 				ss << "unexpected characters after style property name at line " << this->line;
-				throw malformed_css_error(ss.str());
+				this->fail(ss.str());
+				return;
 		}
 	}
 }
@@ -435,3 +869,75 @@ void parser::parse_property_value(utki::span<const char>::iterator& i, utki::spa
 		}
 	}
 }
+
+bool parser::notify_at_rule_block()
+{
+	auto str = utki::trim(utki::make_string_view(this->buf));
+
+	auto name_end = std::find_if(str.begin(), str.end(), [](char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '(';
+	});
+
+	auto name = str.substr(0, size_t(std::distance(str.begin(), name_end)));
+
+	if (name != "media") {
+		std::stringstream ss;
+		ss << "unsupported at-rule @" << name << " at line " << this->line;
+		this->fail(ss.str());
+		return false;
+	}
+
+	if (this->inside_media_block) {
+		std::stringstream ss;
+		ss << "nested @media blocks are not supported, at line " << this->line;
+		this->fail(ss.str());
+		return false;
+	}
+
+	this->on_media_begin(std::string(utki::trim_front(str.substr(name.size()))));
+	if (this->failed) {
+		return false;
+	}
+	this->inside_media_block = true;
+	this->buf.clear();
+	return true;
+}
+
+void parser::parse_at_rule(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e)
+{
+	for (; i != e; ++i) {
+		switch (*i) {
+			case '\n':
+				++this->line;
+				this->buf.push_back(*i);
+				break;
+			case '{':
+				if (!this->notify_at_rule_block()) {
+					return;
+				}
+				this->cur_state = state::idle;
+				return;
+			case ';':
+				// statement at-rule, only @charset is supported, it is ignored since the input is UTF-8 anyway
+				if (utki::make_string_view(this->buf).substr(0, std::string_view("charset").size()) != "charset") {
+					std::stringstream ss;
+					ss << "unsupported at-rule @" << utki::make_string_view(this->buf) << " at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+				this->buf.clear();
+				this->cur_state = state::idle;
+				return;
+			case '}':
+				{
+					std::stringstream ss;
+					ss << "unexpected } inside of at-rule at line " << this->line;
+					this->fail(ss.str());
+					return;
+				}
+			default:
+				this->buf.push_back(*i);
+				break;
+		}
+	}
+}
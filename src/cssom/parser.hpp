@@ -38,6 +38,18 @@ public:
 	{}
 };
 
+/**
+ * @brief CSS parsing error.
+ */
+struct parse_error {
+	/**
+	 * @brief Line number where the error was encountered, 0-based.
+	 */
+	uint32_t line;
+
+	std::string message;
+};
+
 class parser
 {
 	uint32_t line = 0;
@@ -48,29 +60,74 @@ class parser
 		selector_id,
 		selector_tag,
 		selector_class,
+		selector_attribute,
+		selector_pseudo_class,
+		simple_selector_end, // end of attribute selector or functional pseudo-class
 		combinator,
 		property_name,
 		property_value_delimiter, // colon between property name and value
-		property_value
+		property_value,
+		at_rule, // at-rule name and prelude
+		skipped_rule // skipping malformed rule in error recovery mode
 	};
 
 	state cur_state = state::idle;
 
 	std::vector<char> buf;
 
+	// quote character of the currently parsed attribute selector value, 0 if not inside of quotes
+	char attribute_quote = 0;
+
+	// nesting level of parentheses inside of currently parsed pseudo-class
+	unsigned pseudo_class_paren_depth = 0;
+
+	// whether the parser is inside of a @media block
+	bool inside_media_block = false;
+
+	bool error_recovery = false;
+
+	// set by fail() in error recovery mode, the error is handled after current character has been processed
+	bool failed = false;
+	std::string error_message;
+
+	// nesting level of curly braces inside of the skipped rule
+	unsigned skipped_rule_brace_depth = 0;
+
 	void parse_idle(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_style_idle(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_selector_tag(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_selector_id(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_selector_class(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+	void parse_selector_attribute(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+	void parse_selector_pseudo_class(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+	void parse_simple_selector_end(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_combinator(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_property_name(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_property_value_delimiter(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
 	void parse_property_value(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+	void parse_at_rule(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+	void parse_skipped_rule(utki::span<const char>::iterator& i, utki::span<const char>::iterator& e);
+
+	void recover(char c);
+	void end_skipped_rule();
 
 	void notify_selector_tag();
 	void notify_selector_id();
 	void notify_selector_class();
+	bool notify_selector_attribute();
+	void notify_selector_pseudo_class();
+	bool notify_at_rule_block();
+
+protected:
+	/**
+	 * @brief Report parsing error.
+	 * In error recovery mode the error is reported via on_error() after the current character has been processed,
+	 * and the rule containing the error is skipped. Only the first error of a rule is reported.
+	 * Can be called from the parser callbacks to reject the rule being parsed.
+	 * @param message - error message.
+	 * @throw malformed_css_error if error recovery mode is off.
+	 */
+	void fail(std::string message);
 
 public:
 	parser() = default;
@@ -88,11 +145,92 @@ public:
 	virtual void on_selector_tag(std::string str) = 0;
 	virtual void on_selector_id(std::string str) = 0;
 	virtual void on_selector_class(std::string str) = 0;
+
+	/**
+	 * @brief Attribute selector parsed.
+	 * The default implementation rejects the selector as not supported, see fail().
+	 * @param name - attribute name.
+	 * @param operation - attribute value matching operation, one of "=", "~=", "|=", "^=", "$=", "*=",
+	 *                    or empty string if attribute selector only checks for attribute presence.
+	 * @param value - attribute value, with quotes removed.
+	 */
+	virtual void on_selector_attribute(std::string name, std::string operation, std::string value)
+	{
+		this->fail("attribute selectors are not supported");
+	}
+
+	/**
+	 * @brief Pseudo-class parsed.
+	 * Pseudo-elements are also reported as pseudo-classes, their name begins with ':' then.
+	 * The default implementation rejects the selector as not supported, see fail().
+	 * @param name - pseudo-class name, without the leading ':'.
+	 * @param argument - argument of a functional pseudo-class, i.e. text between the parentheses,
+	 *                   or empty string if pseudo-class has no argument.
+	 */
+	virtual void on_selector_pseudo_class(std::string name, std::string argument)
+	{
+		this->fail("pseudo-classes are not supported");
+	}
+
 	virtual void on_combinator(std::string str) = 0;
 	virtual void on_style_properties_end() = 0;
 	virtual void on_property_name(std::string str) = 0;
 	virtual void on_property_value(std::string str) = 0;
 
+	/**
+	 * @brief Beginning of @media block parsed.
+	 * All the styles parsed until on_media_end() belong to the block.
+	 * Nested @media blocks are not supported.
+	 * The default implementation rejects the block as not supported, see fail().
+	 * @param condition - media condition, i.e. text between @media and the opening curly brace, trimmed.
+	 */
+	virtual void on_media_begin(std::string condition)
+	{
+		this->fail("@media is not supported");
+	}
+
+	/**
+	 * @brief End of @media block parsed.
+	 * The default implementation does nothing.
+	 */
+	virtual void on_media_end() {}
+
+	/**
+	 * @brief Parsing error encountered in error recovery mode.
+	 * Called before skipping the rule containing the error. The rule parts already reported by other callbacks
+	 * are to be discarded. The default implementation does nothing.
+	 * @param error - the error.
+	 */
+	virtual void on_error(const parse_error& error) {}
+
+	/**
+	 * @brief Enable or disable error recovery mode.
+	 * By default the error recovery mode is off and the parser throws malformed_css_error on the first error.
+	 * In error recovery mode the parser does not throw, instead it reports the error via on_error(),
+	 * then skips the malformed rule up to its closing curly brace and continues parsing after it,
+	 * as CSS error handling rules prescribe.
+	 * @param enable - whether to enable the error recovery mode.
+	 */
+	void set_error_recovery(bool enable) noexcept
+	{
+		this->error_recovery = enable;
+	}
+
+	bool is_error_recovery_enabled() const noexcept
+	{
+		return this->error_recovery;
+	}
+
+	/**
+	 * @brief Check if the parser is outside of any style or at-rule block.
+	 * Note, that the parser is idle also in between comma separated selector chains.
+	 * @return true if the parser is idle.
+	 */
+	bool is_idle() const noexcept
+	{
+		return this->cur_state == state::idle && !this->inside_media_block;
+	}
+
 	/**
 	 * @brief feed UTF-8 data to parser.
 	 * @param data - data to be fed to parser.
@@ -0,0 +1,100 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include <algorithm>
+
+#include "om.hpp"
+
+using namespace cssom;
+
+void document_features::add(const styleable& node)
+{
+	if (auto tag = node.get_tag(); !tag.empty() && this->tags.find(tag) == this->tags.end()) {
+		this->tags.insert(std::string(tag));
+	}
+
+	if (auto id = node.get_id(); !id.empty() && this->ids.find(id) == this->ids.end()) {
+		this->ids.insert(std::string(id));
+	}
+
+	for (const auto& c : node.get_classes()) {
+		if (this->classes.find(c) == this->classes.end()) {
+			this->classes.insert(c);
+		}
+	}
+}
+
+bool document_features::can_match(const selector& sel) const
+{
+	if (!sel.tag.empty() && sel.tag.back() != '*') {
+		if (this->tags.find(sel.tag) == this->tags.end()) {
+			return false;
+		}
+	}
+
+	if (!sel.id.empty()) {
+		if (this->ids.find(sel.id) == this->ids.end()) {
+			return false;
+		}
+	}
+
+	return std::all_of(sel.classes.begin(), sel.classes.end(), [this](const auto& c) {
+		return this->classes.find(c) != this->classes.end();
+	});
+}
+
+namespace {
+void purge_styles(std::vector<style>& styles, const document_features& features)
+{
+	// the order of styles is preserved, so the styles stay sorted
+	auto i = std::remove_if(
+		styles.begin(), //
+		styles.end(),
+		[&features](const auto& s) {
+			return !std::all_of(s.selectors.begin(), s.selectors.end(), [&features](const auto& sel) {
+				return features.can_match(sel);
+			});
+		}
+	);
+
+	styles.erase(i, styles.end());
+}
+} // namespace
+
+sheet sheet::purge_unused(const document_features& features) const
+{
+	sheet ret = *this;
+
+	purge_styles(ret.styles, features);
+
+	for (auto& b : ret.media_blocks) {
+		purge_styles(b.styles, features);
+	}
+
+	ret.remove_unused_property_lists();
+
+	return ret;
+}
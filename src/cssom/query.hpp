@@ -0,0 +1,129 @@
+/*
+MIT License
+
+Copyright (c) 2020-2024 Ivan Gagis
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ================ LICENSE END ================ */
+
+
+#pragma once
+
+#include <utki/debug.hpp>
+#include <utki/span.hpp>
+
+#include "instrumentation.hpp"
+#include "om.hpp"
+
+// Internal header, shared implementation of multi-property queries.
+
+namespace cssom::detail {
+
+inline const style& as_style(const style& s) noexcept
+{
+	return s;
+}
+
+inline const style& as_style(const style* s) noexcept
+{
+	ASSERT(s)
+	return *s;
+}
+
+/**
+ * @brief Get values of several properties for given xml document node.
+ * Implementation of sheet::get_property_values() and media_view::get_property_values().
+ * @param styles - styles in the order of precedence, range of style or const style* elements.
+ * @param get_properties - function returning property list of a style.
+ * @param crawler - crawler pointing to the node to get the property values for.
+ * @param property_ids - ids of the properties to get.
+ * @param out - query results, one for each property id. Must have same size as property_ids.
+ * @return number of resolved properties.
+ */
+template <typename styles_type, typename get_properties_type>
+size_t get_property_values(
+	const styles_type& styles,
+	const get_properties_type& get_properties,
+	xml_dom_crawler& crawler,
+	utki::span<const uint32_t> property_ids,
+	utki::span<sheet::query_result> out
+)
+{
+	ASSERT(property_ids.size() == out.size())
+
+	CSSOM_INSTRUMENTATION_COUNT(queries);
+
+	for (auto& r : out) {
+		// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+		r = sheet::query_result{nullptr, 0};
+	}
+
+	size_t num_resolved = 0;
+
+	for (const auto& e : styles) {
+		if (num_resolved == out.size()) {
+			break;
+		}
+
+		const style& s = as_style(e);
+
+		const property_list& props = get_properties(s);
+
+		// checking the property list is cheaper than matching, so check it first
+		bool defines_unresolved = false;
+		for (size_t i = 0; i != property_ids.size(); ++i) {
+			if (!out[i].value && props.find(property_ids[i]) != props.end()) {
+				defines_unresolved = true;
+				break;
+			}
+		}
+
+		if (!defines_unresolved) {
+			continue;
+		}
+
+		CSSOM_INSTRUMENTATION_COUNT(rules_examined);
+		CSSOM_INSTRUMENTATION_COUNT(crawler_reset_calls);
+		crawler.reset();
+
+		if (!s.is_matching(crawler)) {
+			continue;
+		}
+
+		CSSOM_INSTRUMENTATION_COUNT(matches);
+
+		for (size_t i = 0; i != property_ids.size(); ++i) {
+			if (out[i].value) {
+				continue;
+			}
+			auto p = props.find(property_ids[i]);
+			if (p != props.end()) {
+				// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+				out[i] = sheet::query_result{p->second.get(), s.specificity};
+				++num_resolved;
+			}
+		}
+	}
+
+	return num_resolved;
+}
+
+} // namespace cssom::detail
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <utki/debug.hpp>
+
+#include "../../src/cssom/om.hpp"
+
+// Flat array based document tree for benchmarking.
+// Each node refers to its parent and preceding sibling by index, so
+// all crawler moves are O(1) and do not allocate.
+
+constexpr size_t no_node = std::numeric_limits<size_t>::max();
+
+class dom_node : public cssom::styleable
+{
+public:
+	std::string id;
+	std::string tag;
+	std::vector<std::string> classes;
+
+	size_t parent = no_node;
+	size_t prev_sibling = no_node;
+
+	std::string_view get_id() const override
+	{
+		return this->id;
+	}
+
+	std::string_view get_tag() const override
+	{
+		return this->tag;
+	}
+
+	utki::span<const std::string> get_classes() const override
+	{
+		return utki::make_span(this->classes);
+	}
+};
+
+class dom
+{
+	std::vector<size_t> last_child;
+
+public:
+	std::vector<dom_node> nodes;
+
+	/**
+	 * @brief Add node to the tree.
+	 * @param parent - index of the parent node, or no_node to add a root node.
+	 * @return index of the added node.
+	 */
+	size_t add(size_t parent, std::string tag, std::string id = std::string(), std::vector<std::string> classes = {})
+	{
+		size_t index = this->nodes.size();
+
+		dom_node n;
+		n.tag = std::move(tag);
+		n.id = std::move(id);
+		n.classes = std::move(classes);
+		n.parent = parent;
+
+		if (parent != no_node) {
+			ASSERT(parent < this->nodes.size())
+			n.prev_sibling = this->last_child[parent];
+			this->last_child[parent] = index;
+		}
+
+		this->nodes.push_back(std::move(n));
+		this->last_child.push_back(no_node);
+
+		return index;
+	}
+};
+
+class array_crawler : public cssom::xml_dom_crawler
+{
+	const std::vector<dom_node>& nodes;
+	size_t start;
+	size_t cur;
+
+public:
+	array_crawler(const dom& d, size_t node) :
+		nodes(d.nodes),
+		start(node),
+		cur(node)
+	{}
+
+	void set_node(size_t node)
+	{
+		this->start = node;
+		this->cur = node;
+	}
+
+	const cssom::styleable& get() override
+	{
+		return this->nodes[this->cur];
+	}
+
+	bool move_up() override
+	{
+		auto p = this->nodes[this->cur].parent;
+		if (p == no_node) {
+			return false;
+		}
+		this->cur = p;
+		return true;
+	}
+
+	bool move_left() override
+	{
+		auto p = this->nodes[this->cur].prev_sibling;
+		if (p == no_node) {
+			return false;
+		}
+		this->cur = p;
+		return true;
+	}
+
+	void reset() override
+	{
+		this->cur = this->start;
+	}
+};
@@ -0,0 +1,392 @@
+// Matching benchmark.
+// Measures sheet::get_property_value() on synthetic documents and style sheets
+// and prints the results as JSON to stdout.
+//
+// Usage: bench [--max-rules=<n>] [--min-time-ms=<n>]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cssom/frozen.hpp>
+
+#include "dom.hpp"
+
+namespace {
+const std::vector<std::string> tags = {
+	"svg",
+	"g",
+	"rect",
+	"circle",
+	"path",
+	"text",
+	"use",
+	"div",
+	"span",
+	"p",
+	"a",
+	"ul",
+	"li"
+};
+
+constexpr size_t num_classes = 50;
+constexpr uint32_t num_properties = 8;
+
+struct value : public cssom::property_value_base {
+	uint32_t v;
+
+	value(uint32_t v) :
+		v(v)
+	{}
+};
+
+std::string random_tag(std::mt19937& rng)
+{
+	return tags[std::uniform_int_distribution<size_t>(0, tags.size() - 1)(rng)];
+}
+
+std::string random_class(std::mt19937& rng)
+{
+	return std::string("c") + std::to_string(std::uniform_int_distribution<size_t>(0, num_classes - 1)(rng));
+}
+
+std::vector<std::string> random_classes(std::mt19937& rng)
+{
+	std::vector<std::string> ret;
+	auto n = std::uniform_int_distribution<size_t>(0, 2)(rng);
+	for (size_t i = 0; i != n; ++i) {
+		ret.push_back(random_class(rng));
+	}
+	return ret;
+}
+} // namespace
+
+namespace {
+// single chain of nested nodes
+dom make_deep_tree(std::mt19937& rng, size_t depth)
+{
+	dom d;
+	size_t parent = no_node;
+	for (size_t i = 0; i != depth; ++i) {
+		parent = d.add(parent, random_tag(rng), std::string(), random_classes(rng));
+	}
+	return d;
+}
+
+// root with a lot of children
+dom make_wide_tree(std::mt19937& rng, size_t width)
+{
+	dom d;
+	auto root = d.add(no_node, "svg");
+	for (size_t i = 0; i != width; ++i) {
+		d.add(root, random_tag(rng), std::string(), random_classes(rng));
+	}
+	return d;
+}
+
+// random tree resembling real world SVG/HTML documents:
+// moderate depth, a few to a few dozens of children per node, occasional ids
+dom make_document_tree(std::mt19937& rng, size_t size)
+{
+	dom d;
+	d.add(no_node, "svg", "root");
+
+	std::uniform_int_distribution<size_t> id_dist(0, 19);
+	for (size_t i = 1; i != size; ++i) {
+		// prefer recently added nodes as parents, this gives depth of about 10 to 20
+		auto parent = std::uniform_int_distribution<size_t>(i > 32 ? i - 32 : 0, i - 1)(rng);
+		std::string id;
+		if (id_dist(rng) == 0) {
+			id = std::string("id") + std::to_string(i);
+		}
+		d.add(parent, random_tag(rng), std::move(id), random_classes(rng));
+	}
+	return d;
+}
+} // namespace
+
+namespace {
+cssom::selector make_random_selector(std::mt19937& rng, size_t num_ids)
+{
+	cssom::selector sel;
+	switch (std::uniform_int_distribution<int>(0, 19)(rng)) {
+		case 0:
+			sel.tag = "*";
+			break;
+		case 1:
+		case 2:
+			sel.id = std::string("id") + std::to_string(std::uniform_int_distribution<size_t>(0, num_ids)(rng));
+			break;
+		case 3:
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+			sel.classes.push_back(random_class(rng));
+			break;
+		case 8:
+		case 9:
+		case 10:
+			sel.tag = random_tag(rng);
+			sel.classes.push_back(random_class(rng));
+			break;
+		default:
+			sel.tag = random_tag(rng);
+			break;
+	}
+	return sel;
+}
+
+cssom::combinator make_random_combinator(std::mt19937& rng)
+{
+	auto n = std::uniform_int_distribution<int>(0, 99)(rng);
+	if (n < 60) {
+		return cssom::combinator::descendant;
+	} else if (n < 85) {
+		return cssom::combinator::child;
+	} else if (n < 93) {
+		return cssom::combinator::next_sibling;
+	}
+	return cssom::combinator::subsequent_sibling;
+}
+
+cssom::sheet make_sheet(std::mt19937& rng, size_t num_rules, size_t num_ids)
+{
+	cssom::sheet s;
+	s.styles.reserve(num_rules);
+
+	for (size_t i = 0; i != num_rules; ++i) {
+		cssom::style st;
+
+		auto chain_length = std::uniform_int_distribution<size_t>(1, 4)(rng);
+		for (size_t j = 0; j != chain_length; ++j) {
+			auto sel = make_random_selector(rng, num_ids);
+			if (j != chain_length - 1) {
+				sel.combinator = make_random_combinator(rng);
+			}
+			st.selectors.push_back(std::move(sel));
+		}
+
+		cssom::property_list props;
+		auto num_props = std::uniform_int_distribution<uint32_t>(1, 3)(rng);
+		for (uint32_t j = 0; j != num_props; ++j) {
+			auto id = std::uniform_int_distribution<uint32_t>(0, num_properties - 1)(rng);
+			props[id] = cssom::make_property_value<value>(uint32_t(i));
+		}
+		st.properties_index = s.add_property_list(std::move(props));
+
+		st.update_specificity();
+		s.styles.push_back(std::move(st));
+	}
+
+	s.sort_styles_by_specificity();
+
+	return s;
+}
+} // namespace
+
+namespace {
+// Worst case for backtracking: a chain of nested 'b' nodes with 'c' leaf node and
+// a style 'a > b b ... b c' which does not match because there is no 'a' node.
+// Matching without memoization would try all combinations of 'b' ancestors.
+dom make_backtracking_tree(size_t depth)
+{
+	dom d;
+	size_t parent = no_node;
+	for (size_t i = 0; i != depth - 1; ++i) {
+		parent = d.add(parent, "b");
+	}
+	d.add(parent, "c");
+	return d;
+}
+
+cssom::sheet make_backtracking_sheet(size_t chain_length)
+{
+	cssom::style st;
+
+	cssom::selector a;
+	a.tag = "a";
+	a.combinator = cssom::combinator::child;
+	st.selectors.push_back(std::move(a));
+
+	for (size_t i = 0; i != chain_length - 2; ++i) {
+		cssom::selector b;
+		b.tag = "b";
+		b.combinator = cssom::combinator::descendant;
+		st.selectors.push_back(std::move(b));
+	}
+
+	cssom::selector c;
+	c.tag = "c";
+	st.selectors.push_back(std::move(c));
+
+	cssom::sheet s;
+
+	cssom::property_list props;
+	props[0] = cssom::make_property_value<value>(0);
+	st.properties_index = s.add_property_list(std::move(props));
+	st.update_specificity();
+
+	s.styles.push_back(std::move(st));
+	return s;
+}
+} // namespace
+
+namespace {
+struct result {
+	size_t num_queries = 0;
+	size_t num_found = 0;
+	double seconds = 0;
+};
+
+// sheet_type is cssom::sheet or cssom::frozen_sheet
+template <typename sheet_type>
+result run(
+	const dom& d,
+	const sheet_type& s,
+	const std::vector<size_t>& sample_nodes,
+	std::chrono::milliseconds min_time
+)
+{
+	array_crawler crawler(d, 0);
+
+	result ret;
+
+	auto start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration elapsed{};
+
+	// at least one query is always done, even if it takes longer than min_time
+	for (size_t i = 0; elapsed < min_time; ++i) {
+		crawler.set_node(sample_nodes[i % sample_nodes.size()]);
+		auto qr = s.get_property_value(crawler, uint32_t(i % num_properties));
+		if (qr.value) {
+			++ret.num_found;
+		}
+		++ret.num_queries;
+
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+
+	ret.seconds = std::chrono::duration<double>(elapsed).count();
+
+	return ret;
+}
+} // namespace
+
+namespace {
+void print_result(
+	bool first,
+	std::string_view tree,
+	size_t nodes,
+	size_t rules,
+	size_t chain_length,
+	std::string_view sheet_kind,
+	const result& r
+)
+{
+	if (!first) {
+		std::cout << ",";
+	}
+
+	std::cout << "\n{\"tree\":\"" << tree << "\",\"nodes\":" << nodes << ",\"rules\":" << rules;
+	if (chain_length != 0) {
+		std::cout << ",\"chain_length\":" << chain_length;
+	}
+	std::cout << ",\"sheet\":\"" << sheet_kind << "\"";
+	std::cout << ",\"queries\":" << r.num_queries << ",\"found\":" << r.num_found << ",\"seconds\":" << r.seconds
+			  << ",\"queries_per_second\":" << double(r.num_queries) / r.seconds
+			  << ",\"ns_per_query\":" << r.seconds * 1e9 / double(r.num_queries) << "}";
+}
+} // namespace
+
+namespace {
+std::optional<size_t> parse_option(std::string_view arg, std::string_view name)
+{
+	if (arg.substr(0, name.size()) != name) {
+		return std::nullopt;
+	}
+	return size_t(std::stoull(std::string(arg.substr(name.size()))));
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	size_t max_rules = 100000;
+	std::chrono::milliseconds min_time(200);
+
+	for (int i = 1; i < argc; ++i) {
+		std::string_view arg = utki::make_span(argv, argc)[i];
+		if (auto v = parse_option(arg, "--max-rules="); v.has_value()) {
+			max_rules = v.value();
+		} else if (auto v = parse_option(arg, "--min-time-ms="); v.has_value()) {
+			min_time = std::chrono::milliseconds(v.value());
+		} else {
+			std::cerr << "unknown argument: " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	std::mt19937 rng(1); // NOLINT(cert-msc32-c, cert-msc51-cpp, "fixed seed for reproducible results")
+
+	struct tree {
+		std::string_view name;
+		dom d;
+	};
+
+	std::vector<tree> trees;
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	trees.push_back({"deep", make_deep_tree(rng, 500)});
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	trees.push_back({"wide", make_wide_tree(rng, 2000)});
+	// NOLINTNEXTLINE(modernize-use-designated-initializers, "need C++20 for that, while we use C++17")
+	trees.push_back({"document", make_document_tree(rng, 10000)});
+
+	std::cout << "{\"benchmarks\":[";
+
+	bool first = true;
+	for (size_t num_rules = 100; num_rules <= max_rules; num_rules *= 10) {
+		for (const auto& t : trees) {
+			auto s = make_sheet(rng, num_rules, t.d.nodes.size());
+
+			constexpr size_t num_sample_nodes = 256;
+
+			std::vector<size_t> sample_nodes;
+			std::uniform_int_distribution<size_t> node_dist(0, t.d.nodes.size() - 1);
+			for (size_t i = 0; i != num_sample_nodes; ++i) {
+				sample_nodes.push_back(node_dist(rng));
+			}
+
+			print_result(first, t.name, t.d.nodes.size(), num_rules, 0, "plain", run(t.d, s, sample_nodes, min_time));
+			first = false;
+
+			cssom::frozen_sheet fs(std::move(s));
+			print_result(first, t.name, t.d.nodes.size(), num_rules, 0, "frozen", run(t.d, fs, sample_nodes, min_time));
+		}
+	}
+
+	// time per query is expected to grow linearly with depth and chain length
+	for (size_t depth : {100, 1000, 10000}) {
+		auto d = make_backtracking_tree(depth);
+		for (size_t chain_length : {4, 16}) {
+			auto s = make_backtracking_sheet(chain_length);
+			print_result(
+				first, //
+				"backtracking",
+				depth,
+				1,
+				chain_length,
+				"plain",
+				run(d, s, {depth - 1}, min_time)
+			);
+		}
+	}
+
+	std::cout << "\n]}" << std::endl;
+
+	return 0;
+}
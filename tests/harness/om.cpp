@@ -4,6 +4,16 @@
 #include <fsif/span_file.hpp>
 
 cssom::sheet read_css(const char* css){
+	return read_css(
+			css,
+			[](uint32_t id, std::string_view v) -> std::unique_ptr<cssom::property_value_base> {
+				auto ret = std::make_unique<property_value>(std::string(v));
+				return ret;
+			}
+		);
+}
+
+cssom::sheet read_css(const char* css, std::function<cssom::property_value_holder(uint32_t, std::string_view)> parse_value){
 	auto pntim = &property_name_to_id_map;
 
 	return cssom::read(
@@ -15,9 +25,6 @@ cssom::sheet read_css(const char* css){
 				}
 				return uint32_t(i->second);
 			},
-			[](uint32_t id, std::string_view v) -> std::unique_ptr<cssom::property_value_base> {
-				auto ret = std::make_unique<property_value>(std::string(v));
-				return ret;
-			}
+			std::move(parse_value)
 		);
 }
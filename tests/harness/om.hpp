@@ -1,5 +1,8 @@
 #pragma once
 
+#include <functional>
+#include <map>
+
 #include <utki/tree.hpp>
 
 #include "../../src/cssom/om.hpp"
@@ -13,6 +16,8 @@ public:
 
 	std::vector<std::string> classes{};
 
+	std::map<std::string, std::string, std::less<>> attributes{};
+
 	om_node(std::string tag, std::string id, std::vector<std::string> classes = std::vector<std::string>()) :
 			id(std::move(id)),
 			tag(std::move(tag)),
@@ -35,6 +40,14 @@ public:
 	utki::span<const std::string> get_classes()const override{
 		return utki::make_span(this->classes);
 	}
+
+	std::optional<std::string_view> get_attribute(std::string_view name)const override{
+		auto i = this->attributes.find(name);
+		if(i == this->attributes.end()){
+			return std::nullopt;
+		}
+		return i->second;
+	}
 };
 
 class crawler : public cssom::xml_dom_crawler{
@@ -86,6 +99,27 @@ public:
 		return true;
 	}
 
+	bool move_right(){
+		ASSERT(this->stack.back().first)
+		auto& c = *this->stack.back().first;
+		auto& i = this->stack.back().second;
+
+		if(std::next(i) == c.end()){
+			return false;
+		}
+
+		++i;
+		return true;
+	}
+
+	std::optional<cssom::sibling_position> get_sibling_position()override{
+		ASSERT(this->stack.back().first)
+		auto& c = *this->stack.back().first;
+		auto& i = this->stack.back().second;
+
+		return cssom::sibling_position{size_t(std::distance(c.begin(), i)), c.size()};
+	}
+
 	bool move_up()override{
 		if(this->stack.size() == 1){
 			return false;
@@ -101,3 +135,4 @@ public:
 };
 
 cssom::sheet read_css(const char* str);
+cssom::sheet read_css(const char* str, std::function<cssom::property_value_holder(uint32_t, std::string_view)> parse_value);
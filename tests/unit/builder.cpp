@@ -0,0 +1,138 @@
+#include <algorithm>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/span_file.hpp>
+
+#include <cssom/builder.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+std::string get_fill(const cssom::sheet& s){
+	using node = utki::tree<om_node>;
+	node::container_type dom{
+		node(om_node("svg"), {
+			node(om_node("rect", std::string(), {"big"}))
+		})
+	};
+
+	crawler cr(dom, {0, 0});
+
+	auto r = s.get_property_value(cr, uint32_t(property_id::fill));
+	if(!r.value){
+		return std::string();
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	return static_cast<const property_value*>(r.value)->value;
+}
+}
+
+namespace{
+const tst::set set("builder", [](tst::suite& suite){
+	suite.add("rules_are_published_as_completed", [](){
+		cssom::sheet_builder b(
+				[](std::string_view name) -> uint32_t{
+					auto i = property_name_to_id_map.find(name);
+					if(i == property_name_to_id_map.end()){
+						return uint32_t(property_id::enum_size);
+					}
+					return uint32_t(i->second);
+				},
+				[](uint32_t id, std::string_view v) -> cssom::property_value_holder{
+					return cssom::make_property_value<property_value>(std::string(v));
+				}
+			);
+
+		tst::check(b.is_complete(), SL);
+		tst::check_eq(get_fill(b.get_sheet()), std::string(), SL);
+
+		b.feed(std::string(".big { fill: red; } rect { fi"));
+		tst::check(!b.is_complete(), SL);
+		tst::check_eq(b.get_sheet().styles.size(), size_t(1), SL);
+		tst::check_eq(get_fill(b.get_sheet()), std::string("red"), SL);
+
+		b.feed(std::string("ll: blue; } .big, svg rect"));
+		tst::check(!b.is_complete(), SL);
+		tst::check_eq(b.get_sheet().styles.size(), size_t(2), SL);
+		tst::check_eq(get_fill(b.get_sheet()), std::string("red"), SL);
+
+		b.feed(std::string(" { fill: green; }\n"));
+		tst::check(b.is_complete(), SL);
+		tst::check_eq(get_fill(b.get_sheet()), std::string("green"), SL);
+
+		auto s = b.build();
+		auto expected = read_css(".big { fill: red; } rect { fill: blue; } .big, svg rect { fill: green; }");
+
+		tst::check_eq(s.styles.size(), expected.styles.size(), SL);
+		for(size_t i = 0; i != s.styles.size(); ++i){
+			tst::check_eq(s.styles[i].get_name(), expected.styles[i].get_name(), SL);
+		}
+	});
+
+	suite.add("end_of_data_closes_incomplete_trailing_rule", [](){
+		auto s = read_css(".big { fill: green; } rect { fill: red;");
+		tst::check_eq(s.styles.size(), size_t(2), SL);
+		tst::check_eq(s.property_lists.size(), size_t(2), SL);
+
+		auto t = read_css("rect { fill: red; }\n.big { fill: green; } .big, rect { fill: blue;");
+		tst::check_eq(t.styles.size(), size_t(4), SL);
+		tst::check_eq(get_fill(t), std::string("blue"), SL);
+	});
+
+	suite.add("malformed_rules_are_skipped_in_error_recovery_mode", [](){
+		auto css = R"qwertyuiop(
+			rect { fill: red; }
+			a##b { fill: blue; }
+			circle { stroke blue; fill: blue; }
+			g:nth-child(x) { fill: green; }
+			@import "foo.css";
+			@media (min-width: 10furlongs) { rect { fill: black; } }
+			path { fill: yellow; }
+			}
+			text { fill: white; }
+		)qwertyuiop";
+
+		std::vector<cssom::parse_error> errors;
+
+		auto s = cssom::read(
+				fsif::span_file(utki::make_span(css, std::char_traits<char>::length(css))),
+				[](std::string_view name) -> uint32_t{
+					auto i = property_name_to_id_map.find(name);
+					if(i == property_name_to_id_map.end()){
+						return uint32_t(property_id::enum_size);
+					}
+					return uint32_t(i->second);
+				},
+				[](uint32_t id, std::string_view v) -> cssom::property_value_holder{
+					return cssom::make_property_value<property_value>(std::string(v));
+				},
+				errors
+			);
+
+		tst::check_eq(errors.size(), size_t(6), SL);
+		tst::check_eq(errors.front().line, uint32_t(2), SL);
+
+		std::vector<std::string> names;
+		for(const auto& st : s.styles){
+			names.push_back(st.get_name());
+		}
+		std::sort(names.begin(), names.end());
+		tst::check(names == std::vector<std::string>{"path", "rect", "text"}, SL);
+		tst::check(s.media_blocks.empty(), SL);
+		tst::check_eq(s.property_lists.size(), size_t(3), SL);
+		tst::check_eq(get_fill(s), std::string("red"), SL);
+
+		// without error recovery the first error is thrown
+		bool thrown = false;
+		try{
+			read_css(css);
+		}catch(const cssom::malformed_css_error&){
+			thrown = true;
+		}
+		tst::check(thrown, SL);
+	});
+});
+}
@@ -0,0 +1,53 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/cascade.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("cascade", [](tst::suite& suite){
+    suite.add("later_sheet_takes_precedence_on_equal_specificity", [](){
+        cssom::cascade cas;
+        cas.push_back(read_css("rect{fill:red;stroke:blue} .big{stroke-width:3}"));
+        cas.push_back(read_css("rect{fill:green}"));
+
+        using node = utki::tree<om_node>;
+        node::container_type dom{
+            node(om_node("body"), {
+                node(om_node("rect", std::string(), {"big"}))
+            })
+        };
+
+        crawler cr(dom, {0, 0});
+
+        {
+            auto qr = cas.get_property_value(cr, uint32_t(property_id::fill));
+            tst::check(qr.value, SL);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+            tst::check_eq(static_cast<const property_value*>(qr.value)->value, std::string("green"), SL);
+        }
+        {
+            auto qr = cas.get_property_value(cr, uint32_t(property_id::stroke));
+            tst::check(qr.value, SL);
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+            tst::check_eq(static_cast<const property_value*>(qr.value)->value, std::string("blue"), SL);
+        }
+        {
+            auto qr = cas.get_property_value(cr, uint32_t(property_id::stroke_width));
+            tst::check(qr.value, SL);
+            tst::check_eq(qr.specificity, uint32_t(1 << 8), SL);
+        }
+
+        auto flat = cas.flatten();
+        tst::check_eq(flat.styles.size(), size_t(3), SL);
+        tst::check_eq(cas.sheets.size(), size_t(2), SL);
+
+        auto qr = flat.get_property_value(cr, uint32_t(property_id::fill));
+        tst::check(qr.value, SL);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const property_value*>(qr.value)->value, std::string("green"), SL);
+    });
+});
+}
@@ -0,0 +1,76 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/embedded.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+struct theme{
+	constexpr static std::string_view css = R"qwertyuiop(
+		rect { fill: red; stroke: blue }
+		.big, svg > g rect.big.round { fill: green; stroke-width: 3; }
+		#main ~ * { fill-opacity : 0.5 ; }
+		rect { fill: yellow; }
+	)qwertyuiop";
+};
+
+struct name_to_id{
+	constexpr uint32_t operator()(std::string_view name)const{
+		if(name == "fill"){
+			return uint32_t(property_id::fill);
+		}else if(name == "stroke"){
+			return uint32_t(property_id::stroke);
+		}else if(name == "stroke-width"){
+			return uint32_t(property_id::stroke_width);
+		}else if(name == "fill-opacity"){
+			return uint32_t(property_id::fill_opacity);
+		}
+		return uint32_t(property_id::enum_size);
+	}
+};
+
+using embedded_theme = cssom::embedded_sheet<theme, name_to_id>;
+
+static_assert(embedded_theme::tables.styles.size() == 5, "unexpected number of styles");
+static_assert(embedded_theme::tables.selectors.size() == 8, "unexpected number of selectors");
+static_assert(embedded_theme::tables.classes.size() == 3, "unexpected number of classes");
+static_assert(embedded_theme::tables.property_lists.size() == 4, "unexpected number of property lists");
+static_assert(embedded_theme::tables.declarations[4].value == "0.5", "property value is not trimmed");
+}
+
+namespace{
+const tst::set set("embedded", [](tst::suite& suite){
+	suite.add("embedded_sheet_is_same_as_read_one", [](){
+		auto parse_value = [](uint32_t id, std::string_view v) -> cssom::property_value_holder{
+			if(id == uint32_t(property_id::enum_size)){
+				return nullptr;
+			}
+			return cssom::make_property_value<property_value>(std::string(v));
+		};
+
+		auto s = embedded_theme::make_sheet(parse_value);
+		auto expected = read_css(std::string(theme::css).c_str(), parse_value);
+
+		tst::check_eq(s.styles.size(), expected.styles.size(), SL);
+		tst::check_eq(s.property_lists.size(), expected.property_lists.size(), SL);
+		for(size_t i = 0; i != s.styles.size(); ++i){
+			const auto& st = s.styles[i];
+			const auto& e = expected.styles[i];
+			tst::check_eq(st.get_name(), e.get_name(), SL);
+			tst::check_eq(st.specificity, e.specificity, SL);
+
+			const auto& props = s.property_lists[st.properties_index];
+			const auto& expected_props = expected.property_lists[e.properties_index];
+			tst::check_eq(props.size(), expected_props.size(), SL);
+			for(const auto& p : expected_props){
+				auto i = props.find(p.first);
+				tst::check(i != props.end(), SL);
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+				tst::check_eq(static_cast<const property_value*>(i->second.get())->value, static_cast<const property_value*>(p.second.get())->value, SL);
+			}
+		}
+	});
+});
+}
@@ -0,0 +1,71 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/frozen.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("frozen", [](tst::suite& suite){
+    suite.add("same_results_as_source_sheet", [](){
+        auto css = R"qwertyuiop(
+            rect { fill: red; }
+            .big { stroke: blue; }
+            rect.big.round { fill: green; }
+            #main { stroke-width: 3; }
+            svg > rect { stroke: black; }
+            g rect[fill] { filter: blur; }
+            * { fill-rule: evenodd; }
+            circle:first-child { fill: yellow; }
+        )qwertyuiop";
+
+        auto s = read_css(css);
+        cssom::frozen_sheet fs(read_css(css));
+
+        om_node filled("rect", std::string(), {"big"});
+        filled.attributes["fill"] = "none";
+
+        // more classes than fit the query's buffer on stack
+        std::vector<std::string> many_classes;
+        for(size_t i = 0; i != 20; ++i){
+            many_classes.push_back(std::string("c") + std::to_string(i));
+        }
+        many_classes.push_back("round");
+        many_classes.push_back("big");
+
+        using node = utki::tree<om_node>;
+        node::container_type dom{
+            node(om_node("svg"), {
+                node(om_node("rect", "main", {"big", "round"})),
+                node(om_node("g"), {
+                    node(om_node("circle")),
+                    node(filled),
+                    node(om_node("text", std::string(), {"big", "unknown"}))
+                }),
+                node(om_node("rect", std::string(), many_classes))
+            })
+        };
+
+        std::vector<std::vector<size_t>> paths = {{0}, {0, 0}, {0, 1}, {0, 1, 0}, {0, 1, 1}, {0, 1, 2}, {0, 2}};
+
+        for(const auto& path : paths){
+            for(uint32_t id = 0; id != uint32_t(property_id::enum_size); ++id){
+                crawler cr(dom, path);
+                auto expected = s.get_property_value(cr, id);
+                auto actual = fs.get_property_value(cr, id);
+
+                tst::check_eq(bool(actual.value), bool(expected.value), SL);
+                tst::check_eq(actual.specificity, expected.specificity, SL);
+                if(expected.value){
+                    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+                    auto e = static_cast<const property_value*>(expected.value)->value;
+                    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+                    auto a = static_cast<const property_value*>(actual.value)->value;
+                    tst::check_eq(a, e, SL);
+                }
+            }
+        }
+    });
+});
+}
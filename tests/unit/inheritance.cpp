@@ -0,0 +1,81 @@
+#include <functional>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/inheritance.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("inheritance", [](tst::suite& suite){
+    suite.add("inherited_values_come_from_nearest_ancestor", [](){
+        auto css = read_css(R"qwertyuiop(
+            svg { fill: red; stroke-width: 2; }
+            g { stroke: blue; }
+            .green { fill: green; }
+        )qwertyuiop");
+
+        using node = utki::tree<om_node>;
+        node::container_type dom{
+            node(om_node("svg"), {
+                node(om_node("g"), {
+                    node(om_node("rect")),
+                    node(om_node("g", std::string(), {"green"}), {
+                        node(om_node("circle"))
+                    })
+                }),
+                node(om_node("path"))
+            })
+        };
+
+        cssom::inheritance_resolver resolver(css, {uint32_t(property_id::stroke), uint32_t(property_id::fill)});
+
+        auto get_value = [&](property_id id) -> std::string {
+            auto qr = resolver.get(uint32_t(id));
+            if(!qr.value){
+                return {};
+            }
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+            return static_cast<const property_value*>(qr.value)->value;
+        };
+
+        // walk the document depth-first
+        std::vector<size_t> path;
+        std::function<void(const node::container_type&)> walk = [&](const node::container_type& nodes){
+            for(size_t i = 0; i != nodes.size(); ++i){
+                path.push_back(i);
+
+                crawler cr(dom, path);
+                resolver.push(cr);
+
+                tst::check_eq(resolver.get_depth(), path.size(), SL);
+
+                const auto& tag = nodes[i].value.tag;
+                if(tag == "rect"){
+                    tst::check_eq(get_value(property_id::fill), std::string("red"), SL);
+                    tst::check_eq(get_value(property_id::stroke), std::string("blue"), SL);
+                }else if(tag == "circle"){
+                    tst::check_eq(get_value(property_id::fill), std::string("green"), SL);
+                    tst::check_eq(get_value(property_id::stroke), std::string("blue"), SL);
+                }else if(tag == "path"){
+                    tst::check_eq(get_value(property_id::fill), std::string("red"), SL);
+                    tst::check_eq(get_value(property_id::stroke), std::string(), SL);
+                }
+
+                // not inherited
+                tst::check_eq(get_value(property_id::stroke_width), std::string(), SL);
+
+                walk(nodes[i].children);
+
+                resolver.pop();
+                path.pop_back();
+            }
+        };
+        walk(dom);
+
+        tst::check_eq(resolver.get_depth(), size_t(0), SL);
+    });
+});
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/instrumentation.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("instrumentation", [](tst::suite& suite){
+    suite.add("counters", [](){
+        auto s = read_css("body rect{fill:red} circle{fill:green} .big{stroke:blue}");
+
+        using node = utki::tree<om_node>;
+        node::container_type dom{
+            node(om_node("body"), {
+                node(om_node("rect", std::string(), {"big"}))
+            })
+        };
+
+        crawler cr(dom, {0, 0});
+
+        cssom::instrumentation::reset_counters();
+
+        // no style has stroke-width, so all styles are examined
+        auto qr = s.get_property_value(cr, uint32_t(property_id::stroke_width));
+        tst::check(!qr.value, SL);
+
+        const auto& c = cssom::instrumentation::get_counters();
+
+        if(cssom::instrumentation::is_enabled()){
+            tst::check_eq(c.queries, uint64_t(1), SL);
+            tst::check_eq(c.rules_examined, uint64_t(3), SL);
+            tst::check_eq(c.crawler_reset_calls, uint64_t(3), SL);
+            tst::check_eq(c.early_rejects, uint64_t(1), SL);
+            tst::check_eq(c.matches, uint64_t(2), SL);
+            tst::check(c.selector_matching_calls >= 3, SL);
+        }else{
+            tst::check_eq(c.queries, uint64_t(0), SL);
+            tst::check_eq(c.rules_examined, uint64_t(0), SL);
+            tst::check_eq(c.matches, uint64_t(0), SL);
+        }
+
+        cssom::instrumentation::reset_counters();
+        tst::check_eq(cssom::instrumentation::get_counters().queries, uint64_t(0), SL);
+    });
+
+    suite.add("style_profiles", [](){
+        auto s = read_css("body rect{fill:red} circle{fill:green} .big{stroke:blue}");
+
+        using node = utki::tree<om_node>;
+        node::container_type dom{
+            node(om_node("body"), {
+                node(om_node("rect", std::string(), {"big"}))
+            })
+        };
+
+        crawler cr(dom, {0, 0});
+
+        cssom::instrumentation::reset_style_profiles();
+        cssom::instrumentation::set_profiling_enabled(true);
+
+        s.get_property_value(cr, uint32_t(property_id::stroke_width));
+        s.get_property_value(cr, uint32_t(property_id::stroke_width));
+
+        cssom::instrumentation::set_profiling_enabled(false);
+
+        const auto& profiles = cssom::instrumentation::get_style_profiles();
+
+        if(!cssom::instrumentation::is_enabled()){
+            tst::check(profiles.empty(), SL);
+            return;
+        }
+
+        tst::check_eq(profiles.size(), size_t(3), SL);
+
+        auto body_rect = std::find_if(s.styles.begin(), s.styles.end(), [](const auto& st){
+            return st.get_name() == "body rect";
+        });
+        tst::check(body_rect != s.styles.end(), SL);
+
+        const auto& p = profiles.at(&*body_rect);
+        tst::check_eq(p.attempts, uint64_t(2), SL);
+        tst::check_eq(p.successes, uint64_t(2), SL);
+        tst::check_eq(p.crawler_steps, uint64_t(2), SL);
+
+        auto report = cssom::instrumentation::make_profile_report();
+        tst::check(report.find("body rect: attempts=2 successes=2 crawler_steps=2") != std::string::npos, SL) << report;
+        tst::check(report.find("circle: attempts=2 successes=0") != std::string::npos, SL) << report;
+
+        cssom::instrumentation::reset_style_profiles();
+    });
+});
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/invalidation.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("invalidation", [](tst::suite& suite){
+    suite.add("invalidation_scopes", [](){
+        auto css = read_css(R"qwertyuiop(
+            .self { fill: red; }
+            .parent rect { fill: red; }
+            .prev + rect { fill: red; }
+            .prev-parent ~ g rect { fill: red; }
+            #id > rect { fill: red; }
+            [href] { fill: red; }
+            li:first-child { fill: red; }
+        )qwertyuiop");
+
+        cssom::invalidation_map map(css);
+
+        {
+            std::vector<std::string> old_classes = {"self", "unused"};
+            std::vector<std::string> new_classes = {"unused", "other"};
+            auto inv = map.classes_changed(old_classes, new_classes);
+            tst::check(inv.self, SL);
+            tst::check(!inv.descendants, SL);
+            tst::check(!inv.siblings, SL);
+            tst::check(!inv.sibling_descendants, SL);
+        }
+        {
+            std::vector<std::string> old_classes = {"unused"};
+            std::vector<std::string> new_classes = {"unused", "parent"};
+            auto inv = map.classes_changed(old_classes, new_classes);
+            tst::check(!inv.self, SL);
+            tst::check(inv.descendants, SL);
+            tst::check(!inv.siblings, SL);
+        }
+        {
+            std::vector<std::string> classes = {"prev"};
+            auto inv = map.classes_changed(classes, {});
+            tst::check(!inv.self, SL);
+            tst::check(!inv.descendants, SL);
+            tst::check(inv.siblings, SL);
+            tst::check(!inv.sibling_descendants, SL);
+        }
+        {
+            std::vector<std::string> classes = {"prev-parent"};
+            auto inv = map.classes_changed({}, classes);
+            tst::check(inv.siblings, SL);
+            tst::check(inv.sibling_descendants, SL);
+        }
+        {
+            std::vector<std::string> classes = {"unused"};
+            tst::check(map.classes_changed({}, classes).is_empty(), SL);
+        }
+
+        tst::check(map.id_changed("", "id").descendants, SL);
+        tst::check(map.id_changed("id", "id").is_empty(), SL);
+        tst::check(map.tag_changed("rect", "circle").self, SL);
+        tst::check(map.attribute_changed("href").self, SL);
+        tst::check(map.attribute_changed("src").is_empty(), SL);
+
+        auto inv = map.children_changed();
+        tst::check(inv.self, SL);
+        tst::check(inv.descendants, SL);
+    });
+
+    suite.add("incremental_update", [](){
+        auto css = read_css(".a .b { fill: red; } .b { fill: green; }");
+
+        cssom::invalidation_map map(css);
+
+        std::vector<std::string> classes = {"b"};
+        tst::check(map.classes_changed({}, classes).self, SL);
+
+        auto remove = [&](size_t chain_length){
+            auto i = std::find_if(css.styles.begin(), css.styles.end(), [&](const auto& s){
+                return s.selectors.size() == chain_length;
+            });
+            tst::check(i != css.styles.end(), SL);
+            auto chain = i->selectors;
+            auto removed = css.remove_style(chain);
+            tst::check_eq(removed.size(), size_t(1), SL);
+            for(const auto& s : removed){
+                map.remove(s);
+            }
+        };
+
+        remove(1);
+
+        tst::check(map.classes_changed({}, classes).self, SL);
+
+        remove(2);
+
+        tst::check(css.styles.empty(), SL);
+        tst::check(map.classes_changed({}, classes).is_empty(), SL);
+    });
+});
+}
@@ -0,0 +1,106 @@
+#include <thread>
+#include <vector>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <cssom/live.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+const tst::set set("live", [](tst::suite& suite){
+    suite.add("publish_while_reading", [](){
+        cssom::live_sheet ls(std::make_shared<const cssom::sheet>(read_css("rect { fill: red; }")));
+
+        using node = utki::tree<om_node>;
+        const node::container_type dom{
+            node(om_node("rect"))
+        };
+
+        auto pinned = ls.get();
+
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> num_found{0};
+
+        std::thread reader_thread([&](){
+            cssom::live_sheet::reader r(ls);
+            crawler cr(dom, {0});
+            while(!stop.load()){
+                auto qr = r.get().get_property_value(cr, uint32_t(property_id::fill));
+                if(qr.value){
+                    ++num_found;
+                }
+            }
+        });
+
+        constexpr auto num_publishes = 100;
+        for(unsigned i = 0; i != num_publishes; ++i){
+            ls.publish(read_css("rect { fill: green; }"));
+        }
+
+        stop.store(true);
+        reader_thread.join();
+
+        tst::check_eq(ls.get_version(), uint64_t(num_publishes), SL);
+
+        // pinned snapshot stays valid and unchanged
+        tst::check_eq(pinned->styles.size(), size_t(1), SL);
+
+        crawler cr(dom, {0});
+        auto qr = ls.get()->get_property_value(cr, uint32_t(property_id::fill));
+        tst::check(qr.value, SL);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const property_value*>(qr.value)->value, std::string("green"), SL);
+
+        qr = pinned->get_property_value(cr, uint32_t(property_id::fill));
+        tst::check(qr.value, SL);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const property_value*>(qr.value)->value, std::string("red"), SL);
+    });
+
+    suite.add("old_versions_are_freed", [](){
+        auto first = std::make_shared<const cssom::sheet>(read_css("rect { fill: red; }"));
+        std::weak_ptr<const cssom::sheet> first_weak = first;
+
+        cssom::live_sheet ls(std::move(first));
+
+        std::atomic<bool> stop{false};
+
+        std::vector<std::thread> readers;
+        for(unsigned i = 0; i != 4; ++i){
+            readers.emplace_back([&](){
+                while(!stop.load()){
+                    auto s = ls.get();
+                    tst::check(s, SL);
+                    tst::check_eq(s->styles.size(), size_t(1), SL);
+                }
+            });
+        }
+
+        std::vector<std::weak_ptr<const cssom::sheet>> published;
+        constexpr auto num_publishes = 100;
+        for(unsigned i = 0; i != num_publishes; ++i){
+            auto s = std::make_shared<const cssom::sheet>(read_css("rect { fill: green; }"));
+            published.emplace_back(s);
+            ls.publish(std::move(s));
+        }
+
+        stop.store(true);
+        for(auto& t : readers){
+            t.join();
+        }
+
+        tst::check_eq(ls.get_version(), uint64_t(num_publishes), SL);
+
+        // only the latest version is alive
+        tst::check(first_weak.expired(), SL);
+        for(size_t i = 0; i != published.size() - 1; ++i){
+            tst::check(published[i].expired(), SL) << "i = " << i;
+        }
+        tst::check(!published.back().expired(), SL);
+        tst::check(ls.get() == published.back().lock(), SL);
+    });
+});
+}
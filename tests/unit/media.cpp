@@ -0,0 +1,206 @@
+#include <array>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/vector_file.hpp>
+
+#include <utki/string.hpp>
+#include <utki/util.hpp>
+
+#include <cssom/media.hpp>
+
+#include "../harness/properties.hpp"
+#include "../harness/om.hpp"
+
+namespace{
+std::string get_value(const cssom::sheet::query_result& r){
+	if(!r.value){
+		return std::string();
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	return static_cast<const property_value*>(r.value)->value;
+}
+}
+
+namespace{
+const tst::set set("media", [](tst::suite& suite){
+	suite.add("media_conditions", [](){
+		auto c = cssom::parse_media_condition(" screen and (min-width: 600px) and (max-width: 50em), print ");
+		tst::check_eq(c.text, std::string("screen and (min-width: 600px) and (max-width: 50em), print"), SL);
+		tst::check_eq(c.queries.size(), size_t(2), SL);
+
+		cssom::media_environment env;
+		env.width = 700;
+		tst::check(!c.is_active(env), SL);
+
+		env.features.insert("screen");
+		tst::check(c.is_active(env), SL);
+
+		env.width = 900;
+		tst::check(!c.is_active(env), SL);
+
+		tst::check(cssom::parse_media_condition("not print").is_active(env), SL);
+		tst::check(cssom::parse_media_condition("(min-resolution: 2dppx)").is_active(env) == false, SL);
+		env.dpi = 192;
+		tst::check(cssom::parse_media_condition("(min-resolution: 2dppx)").is_active(env), SL);
+		tst::check(cssom::parse_media_condition("(orientation: landscape)").is_active(env), SL);
+
+		std::string error;
+		tst::check(!cssom::parse_media_condition("(min-width: 10furlongs)", error).has_value(), SL);
+		tst::check(!error.empty(), SL);
+	});
+
+	suite.add("views_contain_only_active_blocks", [](){
+		cssom::media_sheet ms(read_css(R"qwertyuiop(
+			rect { fill: red; stroke: black; }
+			@media screen and (min-width: 600px) {
+				rect { fill: green; }
+				.big { stroke-width: 3; }
+			}
+			@media (orientation: portrait) {
+				rect { fill: blue; }
+			}
+		)qwertyuiop"));
+
+		tst::check_eq(ms.get_sheet().styles.size(), size_t(1), SL);
+		tst::check_eq(ms.get_sheet().media_blocks.size(), size_t(2), SL);
+
+		using node = utki::tree<om_node>;
+		node::container_type dom{
+			node(om_node("svg"), {
+				node(om_node("rect", std::string(), {"big"}))
+			})
+		};
+
+		crawler cr(dom, {0, 0});
+
+		auto fill = uint32_t(property_id::fill);
+
+		// plain sheet queries do not see the media blocks
+		tst::check_eq(get_value(ms.get_sheet().get_property_value(cr, fill)), std::string("red"), SL);
+
+		cssom::media_environment env;
+		env.features.insert("screen");
+		env.width = 400;
+		env.height = 300;
+		tst::check_eq(get_value(ms.get_view(env).get_property_value(cr, fill)), std::string("red"), SL);
+
+		env.width = 800;
+		const auto& wide = ms.get_view(env);
+		tst::check_eq(get_value(wide.get_property_value(cr, fill)), std::string("green"), SL);
+		tst::check_eq(get_value(wide.get_property_value(cr, uint32_t(property_id::stroke_width))), std::string("3"), SL);
+
+		// the later block takes precedence
+		env.height = 1000;
+		tst::check_eq(get_value(ms.get_view(env).get_property_value(cr, fill)), std::string("blue"), SL);
+
+		std::array<uint32_t, 2> ids = {fill, uint32_t(property_id::stroke)};
+		std::array<cssom::sheet::query_result, ids.size()> results{};
+		tst::check_eq(ms.get_view(env).get_property_values(cr, utki::make_span(ids), utki::make_span(results)), size_t(2), SL);
+		tst::check_eq(get_value(results[0]), std::string("blue"), SL);
+		tst::check_eq(get_value(results[1]), std::string("black"), SL);
+
+		// same set of active blocks reuses the cached view
+		env.width = 900;
+		env.height = 300;
+		tst::check(&ms.get_view(env) == &wide, SL);
+		tst::check_eq(ms.get_num_cached_views(), size_t(3), SL);
+	});
+
+	suite.add("later_rules_take_precedence_over_earlier_media_blocks", [](){
+		auto css = R"qwertyuiop(
+			@media screen { rect { fill: red; } }
+			rect { fill: blue; stroke: blue; }
+			@media screen { rect { stroke: green; } }
+			circle { fill: black; }
+		)qwertyuiop";
+
+		using node = utki::tree<om_node>;
+		node::container_type dom{
+			node(om_node("rect"))
+		};
+
+		crawler cr(dom, {0});
+
+		cssom::media_environment env;
+		env.features.insert("screen");
+
+		for(bool optimize : {false, true}){
+			auto s = read_css(css);
+			if(optimize){
+				s.optimize();
+			}
+			cssom::media_sheet ms(std::move(s));
+
+			const auto& view = ms.get_view(env);
+			tst::check_eq(get_value(view.get_property_value(cr, uint32_t(property_id::fill))), std::string("blue"), SL);
+			tst::check_eq(get_value(view.get_property_value(cr, uint32_t(property_id::stroke))), std::string("green"), SL);
+		}
+	});
+
+	suite.add("cached_views_survive_move", [](){
+		cssom::media_sheet ms(read_css(R"qwertyuiop(
+			rect { fill: red; }
+			@media screen { rect { fill: green; } }
+		)qwertyuiop"));
+
+		using node = utki::tree<om_node>;
+		node::container_type dom{
+			node(om_node("rect"))
+		};
+
+		crawler cr(dom, {0});
+
+		auto fill = uint32_t(property_id::fill);
+
+		cssom::media_environment env;
+		env.features.insert("screen");
+		tst::check_eq(get_value(ms.get_view(env).get_property_value(cr, fill)), std::string("green"), SL);
+
+		cssom::media_sheet moved(std::move(ms));
+		tst::check_eq(moved.get_num_cached_views(), size_t(1), SL);
+		tst::check_eq(get_value(moved.get_view(env).get_property_value(cr, fill)), std::string("green"), SL);
+
+		cssom::media_sheet assigned(cssom::sheet{});
+		assigned = std::move(moved);
+		tst::check_eq(get_value(assigned.get_view(env).get_property_value(cr, fill)), std::string("green"), SL);
+		tst::check_eq(assigned.get_num_cached_views(), size_t(1), SL);
+	});
+
+	suite.add("media_blocks_are_written", [](){
+		auto s = read_css(R"qwertyuiop(
+			rect { fill: red; }
+			@media screen and (min-width: 600px) {
+				rect { fill: green; }
+			}
+		)qwertyuiop");
+
+		auto pitnm = utki::flip_map(property_name_to_id_map);
+
+		fsif::vector_file out_file;
+
+		cssom::sheet::write_options options;
+		options.minify = true;
+
+		s.write(
+			out_file,
+			[&pitnm](uint32_t id) -> std::string{
+				return pitnm.at(id);
+			},
+			[](uint32_t id, const cssom::property_value_base& value) -> std::string{
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+				return static_cast<const property_value&>(value).value;
+			},
+			options
+		);
+
+		auto data = out_file.reset_data();
+		tst::check_eq(
+			std::string(utki::make_string_view(data)),
+			std::string("rect{fill:red}@media screen and (min-width: 600px){rect{fill:green}}"),
+			SL
+		);
+	});
+});
+}
@@ -26,5 +26,117 @@ const tst::set set("misc", [](tst::suite& suite){
         auto qr = css.get_property_value(cr, uint32_t(property_id::fill));
         tst::check(qr.value, SL);
     });
+
+    suite.add("property_list_is_sorted_by_id", [](){
+        cssom::property_list l;
+        l[uint32_t(property_id::stroke_width)] = std::make_unique<property_value>("3");
+        l[uint32_t(property_id::fill)] = std::make_unique<property_value>("red");
+
+        auto res = l.insert(std::make_pair(uint32_t(property_id::stroke), std::make_unique<property_value>("blue")));
+        tst::check(res.second, SL);
+
+        // inserting existing property does not change the list
+        res = l.insert(std::make_pair(uint32_t(property_id::fill), std::make_unique<property_value>("green")));
+        tst::check(!res.second, SL);
+
+        tst::check_eq(l.size(), size_t(3), SL);
+
+        uint32_t prev = 0;
+        for(const auto& p : l){
+            tst::check(p.first >= prev, SL);
+            prev = p.first;
+        }
+
+        tst::check(l.find(uint32_t(property_id::filter)) == l.end(), SL);
+
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const property_value&>(*l.at(uint32_t(property_id::fill))).value, std::string("red"), SL);
+
+        tst::check_eq(l.erase(uint32_t(property_id::stroke)), size_t(1), SL);
+        tst::check_eq(l.erase(uint32_t(property_id::stroke)), size_t(0), SL);
+        tst::check_eq(l.size(), size_t(2), SL);
+    });
+
+    suite.add("small_property_values_are_stored_inline", [](){
+        struct number_value : public cssom::property_value_base{
+            float value;
+
+            number_value(float value) : value(value) {}
+        };
+
+        static_assert(cssom::property_value_holder::is_stored_inline<number_value>);
+
+        auto css = read_css(
+            "rect{stroke-width:3;fill:red}",
+            [](uint32_t id, std::string_view v) -> cssom::property_value_holder {
+                if(id == uint32_t(property_id::stroke_width)){
+                    return cssom::make_property_value<number_value>(std::stof(std::string(v)));
+                }
+                return std::make_unique<property_value>(std::string(v));
+            }
+        );
+
+        tst::check_eq(css.styles.size(), size_t(1), SL);
+
+        const auto& props = css.get_properties(css.styles.front());
+
+        const auto& sw = props.at(uint32_t(property_id::stroke_width));
+        tst::check(sw.is_inline(), SL);
+        tst::check(dynamic_cast<const number_value*>(sw.get()), SL);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const number_value&>(*sw).value, 3.0f, SL);
+
+        tst::check(!props.at(uint32_t(property_id::fill)).is_inline(), SL);
+
+        // inline value survives moving of the holder
+        cssom::property_list l;
+        l[1] = cssom::make_property_value<number_value>(1.0f);
+        l[0] = cssom::make_property_value<number_value>(0.5f);
+        tst::check(l.at(1).is_inline(), SL);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+        tst::check_eq(static_cast<const number_value&>(*l.at(1)).value, 1.0f, SL);
+    });
+
+    suite.add("parser_rejects_unsupported_constructs_by_default", [](){
+        // parser which only implements the mandatory callbacks
+        class minimal_parser : public cssom::parser{
+        public:
+            size_t num_properties = 0;
+            size_t num_errors = 0;
+
+            void on_selector_chain_end()override{}
+            void on_selector_end()override{}
+            void on_selector_tag(std::string str)override{}
+            void on_selector_id(std::string str)override{}
+            void on_selector_class(std::string str)override{}
+            void on_combinator(std::string str)override{}
+            void on_style_properties_end()override{}
+            void on_property_name(std::string str)override{}
+            void on_property_value(std::string str)override{
+                ++this->num_properties;
+            }
+            void on_error(const cssom::parse_error& error)override{
+                ++this->num_errors;
+            }
+        };
+
+        for(auto css : {"a[href] { fill: red; }", "a:hover { fill: red; }", "@media screen { a { fill: red; } }"}){
+            minimal_parser p;
+            bool thrown = false;
+            try{
+                p.feed(std::string(css));
+            }catch(const cssom::malformed_css_error&){
+                thrown = true;
+            }
+            tst::check(thrown, SL) << css;
+        }
+
+        minimal_parser p;
+        p.set_error_recovery(true);
+        p.feed(std::string("a[href] { fill: red; } @media screen { a { fill: red; } } a { fill: red; }"));
+        tst::check_eq(p.num_errors, size_t(2), SL);
+        tst::check_eq(p.num_properties, size_t(1), SL);
+        tst::check(p.is_idle(), SL);
+    });
 });
 }
@@ -1,7 +1,14 @@
+#include <algorithm>
+#include <array>
+
 #include <tst/set.hpp>
 #include <tst/check.hpp>
 
 #include <fsif/span_file.hpp>
+#include <fsif/vector_file.hpp>
+
+#include <utki/string.hpp>
+#include <utki/util.hpp>
 
 #include <cssom/om.hpp>
 
@@ -39,5 +46,398 @@ const tst::set set("object_model", [](auto& suite){
 			tst::check_eq(css_om1.styles.back().specificity, unsigned(1), SL) << "specificity = " << css_om1.styles.back().specificity;
 		}
 	);
+	suite.add(
+		"insert_remove_style",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect { fill: red; }
+				.cls { fill: green; }
+				#id { fill: blue; }
+			)qwertyuiop");
+
+			auto new_css = read_css("rect { fill: yellow; } circle.cls { stroke: black; }");
+			tst::check_eq(new_css.styles.size(), size_t(2), SL);
+
+			// insert 'rect' style, it should go before existing 'rect' style because it is inserted later
+			auto rect_style = new_css.styles.back();
+			tst::check_eq(rect_style.selectors.front().tag, std::string("rect"), SL);
+			rect_style.properties_index = css_om.add_property_list(std::move(new_css.get_properties(rect_style)));
+			auto index = css_om.insert_style(rect_style);
+			tst::check_eq(index, size_t(2), SL);
+			tst::check_eq(css_om.styles[2].properties_index, rect_style.properties_index, SL);
+
+			auto circle_style = new_css.styles.front();
+			circle_style.properties_index = css_om.add_property_list(std::move(new_css.get_properties(circle_style)));
+			index = css_om.insert_style(circle_style);
+			tst::check_eq(index, size_t(1), SL);
+
+			tst::check_eq(css_om.styles.size(), size_t(5), SL);
+			for(size_t i = 1; i < css_om.styles.size(); ++i){
+				tst::check(css_om.styles[i - 1].specificity >= css_om.styles[i].specificity, SL);
+			}
+
+			auto removed = css_om.remove_style(rect_style.selectors);
+			tst::check_eq(removed.size(), size_t(2), SL);
+			// the inserted style went first
+			tst::check_eq(removed.front().properties_index, rect_style.properties_index, SL);
+			tst::check(css_om.remove_style(rect_style.selectors).empty(), SL);
+			tst::check_eq(css_om.styles.size(), size_t(3), SL);
+		}
+	);
+	suite.add(
+		"write_minified",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect, body > circle { fill: red; stroke: blue; }
+				.cls { fill: green; }
+			)qwertyuiop");
+
+			auto pitnm = utki::flip_map(property_name_to_id_map);
+
+			auto write = [&](bool sort) {
+				fsif::vector_file out_file;
+
+				cssom::sheet::write_options options;
+				options.minify = true;
+				options.sort = sort;
+
+				css_om.write(
+						out_file,
+						[&pitnm](uint32_t id) -> std::string{
+							return pitnm.at(id);
+						},
+						[](uint32_t id, const cssom::property_value_base& value) -> std::string{
+							// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+							return static_cast<const property_value&>(value).value;
+						},
+						options
+					);
+
+				auto data = out_file.reset_data();
+				return std::string(utki::make_string_view(data));
+			};
+
+			tst::check_eq(write(true), std::string(".cls{fill:green}body>circle,rect{fill:red;stroke:blue}"), SL) << write(true);
+
+			// unsorted output goes in order of styles in the sheet, which is by descending specificity
+			tst::check_eq(write(false), std::string(".cls{fill:green}body>circle,rect{fill:red;stroke:blue}"), SL) << write(false);
+		}
+	);
+	suite.add(
+		"unsorted_write_keeps_precedence",
+		[](){
+			auto pitnm = utki::flip_map(property_name_to_id_map);
+
+			auto write = [&](const cssom::sheet& s) {
+				fsif::vector_file out_file;
+
+				cssom::sheet::write_options options;
+				options.minify = true;
+				options.sort = false;
+
+				s.write(
+						out_file,
+						[&pitnm](uint32_t id) -> std::string{
+							return pitnm.at(id);
+						},
+						[](uint32_t id, const cssom::property_value_base& value) -> std::string{
+							// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+							return static_cast<const property_value&>(value).value;
+						},
+						options
+					);
+
+				auto data = out_file.reset_data();
+				return std::string(utki::make_string_view(data));
+			};
+
+			using node = utki::tree<om_node>;
+			node::container_type dom{
+				node(om_node("a", std::string(), {"b"}))
+			};
+
+			auto get_fill = [&](const cssom::sheet& s){
+				crawler cr(dom, {0});
+				auto r = s.get_property_value(cr, uint32_t(property_id::fill));
+				tst::check(r.value, SL);
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+				return static_cast<const property_value*>(r.value)->value;
+			};
+
+			for(auto css : {
+				"a{fill:red} a{stroke:x;fill:blue}",
+				"a{fill:red} a, .b{fill:blue}",
+				"a, *{fill:red} a{fill:blue}",
+				"a, .c{fill:red} .c{fill:green} a, .d{fill:blue}"
+			}){
+				auto s = read_css(css);
+				tst::check_eq(get_fill(s), std::string("blue"), SL) << css;
+
+				auto out = write(s);
+				auto reread = read_css(out.c_str());
+				tst::check_eq(get_fill(reread), std::string("blue"), SL) << css << " -> " << out;
+			}
+		}
+	);
+	suite.add(
+		"optimize",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect { fill: red; stroke: blue; }
+				.cls { fill: green; }
+				rect { fill: yellow; }
+				circle { stroke-width: 3; }
+				line { stroke-width: 3; }
+				path { }
+				rect { stroke-width: 1; }
+			)qwertyuiop");
+
+			tst::check_eq(css_om.styles.size(), size_t(7), SL);
+
+			css_om.optimize(
+				[](uint32_t id, const cssom::property_value_base& a, const cssom::property_value_base& b){
+					// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+					return static_cast<const property_value&>(a).value == static_cast<const property_value&>(b).value;
+				}
+			);
+
+			// 'rect' styles are merged into one, empty 'path' style is removed
+			tst::check_eq(css_om.styles.size(), size_t(4), SL);
+
+			auto find_style = [&](std::string_view tag) -> const cssom::style& {
+				auto i = std::find_if(css_om.styles.begin(), css_om.styles.end(), [&](const auto& s){
+					return s.selectors.front().tag == tag;
+				});
+				tst::check(i != css_om.styles.end(), SL);
+				return *i;
+			};
+
+			const auto& rect = find_style("rect");
+			const auto& rect_props = css_om.get_properties(rect);
+			tst::check_eq(rect_props.size(), size_t(3), SL);
+
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			tst::check_eq(static_cast<const property_value&>(*rect_props.at(uint32_t(property_id::fill))).value, std::string("yellow"), SL);
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			tst::check_eq(static_cast<const property_value&>(*rect_props.at(uint32_t(property_id::stroke))).value, std::string("blue"), SL);
+
+			// equal property lists are shared
+			tst::check_eq(find_style("circle").properties_index, find_style("line").properties_index, SL);
+
+			// unused property lists are removed
+			tst::check_eq(css_om.property_lists.size(), size_t(3), SL);
+		}
+	);
+	suite.add(
+		"purge_unused",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect { fill: red; }
+				svg .used { fill: green; }
+				svg .unused { fill: green; }
+				#used, #unused { stroke: blue; }
+				text { stroke: blue; }
+				* { stroke-width: 3; }
+			)qwertyuiop");
+
+			cssom::document_features features;
+			features.add(om_node("svg"));
+			features.add(om_node("rect", "used", {"used", "other"}));
+
+			auto purged = css_om.purge_unused(features);
+
+			tst::check_eq(purged.styles.size(), size_t(4), SL);
+
+			// property lists of 'svg .unused' and 'text' are not used anymore
+			tst::check_eq(purged.property_lists.size(), size_t(4), SL);
+
+			// original sheet is not modified
+			tst::check_eq(css_om.styles.size(), size_t(7), SL);
+			tst::check_eq(css_om.property_lists.size(), size_t(6), SL);
+
+			for(const auto& s : purged.styles){
+				tst::check(s.selectors.back().tag != "text", SL);
+				tst::check(s.selectors.back().id != "unused", SL);
+				tst::check(s.selectors.back().classes != std::vector<std::string>{"unused"}, SL);
+			}
+		}
+	);
+	suite.add(
+		"copy",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect { fill: red; stroke: blue; }
+				.big { fill: green; }
+				@media print {
+					rect { stroke: black; }
+				}
+			)qwertyuiop");
+
+			cssom::sheet copy = css_om;
+
+			tst::check_eq(copy.styles.size(), css_om.styles.size(), SL);
+			tst::check_eq(copy.property_lists.size(), css_om.property_lists.size(), SL);
+			tst::check_eq(copy.media_blocks.size(), size_t(1), SL);
+
+			using node = utki::tree<om_node>;
+			node::container_type dom{
+				node(om_node("svg"), {
+					node(om_node("rect", std::string(), {"big"}))
+				})
+			};
+
+			crawler cr(dom, {0, 0});
+
+			for(auto id : {property_id::fill, property_id::stroke}){
+				auto expected = css_om.get_property_value(cr, uint32_t(id));
+				auto qr = copy.get_property_value(cr, uint32_t(id));
+				tst::check(qr.value, SL);
+				tst::check(expected.value, SL);
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+				tst::check_eq(static_cast<const property_value*>(qr.value)->value, static_cast<const property_value*>(expected.value)->value, SL);
+			}
+
+			// modifying the copy does not affect the original sheet
+			copy.styles.pop_back();
+			copy.remove_unused_property_lists();
+			tst::check_eq(copy.property_lists.size(), size_t(2), SL);
+			tst::check_eq(css_om.styles.size(), size_t(2), SL);
+			tst::check_eq(css_om.property_lists.size(), size_t(3), SL);
+		}
+	);
+	suite.add(
+		"get_property_values",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect { fill: red; stroke: blue; }
+				.big { stroke-width: 3; fill: green; }
+				circle { filter: blur; }
+			)qwertyuiop");
+
+			using node = utki::tree<om_node>;
+			node::container_type dom{
+				node(om_node("svg"), {
+					node(om_node("rect", std::string(), {"big"}))
+				})
+			};
+
+			crawler cr(dom, {0, 0});
+
+			std::array<uint32_t, 4> ids = {
+				uint32_t(property_id::fill),
+				uint32_t(property_id::stroke),
+				uint32_t(property_id::filter),
+				uint32_t(property_id::stroke_width)
+			};
+			std::array<cssom::sheet::query_result, ids.size()> results{};
+
+			auto num_resolved = css_om.get_property_values(cr, utki::make_span(ids), utki::make_span(results));
+			tst::check_eq(num_resolved, size_t(3), SL);
+
+			for(size_t i = 0; i != ids.size(); ++i){
+				auto expected = css_om.get_property_value(cr, ids[i]);
+				tst::check(results[i].value == expected.value, SL) << "i = " << i;
+				tst::check_eq(results[i].specificity, expected.specificity, SL) << "i = " << i;
+			}
+
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			tst::check_eq(static_cast<const property_value*>(results[0].value)->value, std::string("green"), SL);
+			tst::check(!results[2].value, SL);
+		}
+	);
+	suite.add(
+		"read_several_files",
+		[](){
+			std::array<const char*, 3> sources = {
+				"rect { fill: red; } .big { stroke: blue; }",
+				"rect { fill: green; } @media print { rect { fill: black; } }",
+				"svg rect { stroke: yellow; } rect { stroke-width: 3; }"
+			};
+
+			std::vector<fsif::span_file> files;
+			std::vector<const fsif::file*> file_ptrs;
+			files.reserve(sources.size());
+			std::string concatenated;
+			for(auto src : sources){
+				files.emplace_back(utki::make_span(src, std::char_traits<char>::length(src)));
+				file_ptrs.push_back(&files.back());
+				concatenated.append(src).append("\n");
+			}
+
+			auto s = cssom::read(
+					file_ptrs,
+					[](std::string_view name) -> uint32_t{
+						auto i = property_name_to_id_map.find(name);
+						if(i == property_name_to_id_map.end()){
+							return uint32_t(property_id::enum_size);
+						}
+						return uint32_t(i->second);
+					},
+					[](uint32_t id, std::string_view v) -> cssom::property_value_holder{
+						return cssom::make_property_value<property_value>(std::string(v));
+					},
+					2
+				);
+
+			auto expected = read_css(concatenated.c_str());
+
+			tst::check_eq(s.styles.size(), expected.styles.size(), SL);
+			tst::check_eq(s.media_blocks.size(), size_t(1), SL);
+			for(size_t i = 0; i != s.styles.size(); ++i){
+				tst::check_eq(s.styles[i].get_name(), expected.styles[i].get_name(), SL);
+				tst::check_eq(s.get_properties(s.styles[i]).size(), expected.get_properties(expected.styles[i]).size(), SL);
+			}
+
+			using node = utki::tree<om_node>;
+			node::container_type dom{
+				node(om_node("svg"), {
+					node(om_node("rect"))
+				})
+			};
+
+			crawler cr(dom, {0, 0});
+
+			auto fill = s.get_property_value(cr, uint32_t(property_id::fill));
+			tst::check(fill.value, SL);
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			tst::check_eq(static_cast<const property_value*>(fill.value)->value, std::string("green"), SL);
+		}
+	);
+	suite.add(
+		"memory_usage",
+		[](){
+			auto css_om = read_css(R"qwertyuiop(
+				rect, .a_class_name_which_does_not_fit_into_small_string_buffer { fill: red; }
+				circle { stroke: blue; stroke-width: 3; }
+				@media print {
+					rect { fill: black; }
+				}
+			)qwertyuiop");
+
+			auto report = css_om.memory_usage([](uint32_t id, const cssom::property_value_holder& v) -> size_t{
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+				const auto& pv = static_cast<const property_value&>(*v);
+				return (v.is_inline() ? 0 : sizeof(property_value)) + pv.value.capacity();
+			});
+
+			tst::check_eq(report.num_property_lists, size_t(3), SL);
+			tst::check_eq(report.num_shared_property_lists, size_t(1), SL);
+			tst::check_eq(report.num_unused_property_lists, size_t(0), SL);
+			tst::check_eq(report.num_property_values, size_t(4), SL);
+			tst::check(report.selector_strings > 0, SL);
+			tst::check(report.media_conditions > 0, SL);
+			tst::check(report.property_values >= 4 * sizeof(property_value), SL);
+			tst::check_eq(
+				report.shared_property_lists + report.unique_property_lists,
+				report.property_lists - css_om.property_lists.capacity() * sizeof(cssom::property_list) + report.property_values,
+				SL
+			);
+			tst::check(report.get_total() > report.property_values, SL);
+
+			auto no_values = css_om.memory_usage();
+			tst::check_eq(no_values.property_values, size_t(0), SL);
+			tst::check_eq(no_values.property_lists, report.property_lists, SL);
+		}
+	);
 });
 }
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <tst/set.hpp>
 #include <tst/check.hpp>
 
@@ -61,5 +63,244 @@ const tst::set set("selectors", [](auto& suite){
             }
         }
     );
+    suite.add(
+        "attribute_selectors",
+        [](){
+            auto css = R"qwertyuiop(
+                rect[fill] {
+                    stroke: red;
+                }
+                [class~="big"] {
+                    stroke-width: 3
+                }
+                [lang|=en] { fill: blue; }
+                a[href^='http'][href$=".svg"] { fill: green; }
+                a[href*=example] { stroke: yellow; }
+            )qwertyuiop";
+
+            const auto css_dom = read_css(css);
+
+            tst::check_eq(css_dom.styles.size(), size_t(5), SL);
+
+            om_node rect("rect");
+            rect.attributes["fill"] = "none";
+            rect.attributes["class"] = "small  big";
+
+            om_node text("text");
+            text.attributes["lang"] = "en-US";
+
+            om_node link("a");
+            link.attributes["href"] = "http://example.com/image.svg";
+
+            using node = utki::tree<om_node>;
+            node::container_type dom{
+                node(om_node("svg"), {
+                    node(rect),
+                    node(text),
+                    node(link),
+                    node(om_node("rect"))
+                })
+            };
+
+            auto get_value = [&](std::vector<size_t> index, property_id id) -> std::string {
+                crawler cr(dom, std::move(index));
+                auto qr = css_dom.get_property_value(cr, uint32_t(id));
+                if(!qr.value){
+                    return {};
+                }
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+                return static_cast<const property_value*>(qr.value)->value;
+            };
+
+            tst::check_eq(get_value({0, 0}, property_id::stroke), std::string("red"), SL);
+            tst::check_eq(get_value({0, 0}, property_id::stroke_width), std::string("3"), SL);
+            tst::check_eq(get_value({0, 1}, property_id::fill), std::string("blue"), SL);
+            tst::check_eq(get_value({0, 2}, property_id::fill), std::string("green"), SL);
+            tst::check_eq(get_value({0, 2}, property_id::stroke), std::string("yellow"), SL);
+            tst::check_eq(get_value({0, 3}, property_id::stroke), std::string(), SL);
+
+            // attribute selector specificity is same as class selector specificity
+            auto i = std::find_if(css_dom.styles.begin(), css_dom.styles.end(), [](const auto& s){
+                return s.selectors.size() == 1 && s.selectors.front().tag == "a" && s.selectors.front().attributes.size() == 2;
+            });
+            tst::check(i != css_dom.styles.end(), SL);
+            tst::check_eq(i->specificity, uint32_t((2 << 8) | 1), SL);
+        }
+    );
+    suite.add(
+        "structural_pseudo_classes",
+        [](){
+            auto css = R"qwertyuiop(
+                li:first-child { fill: first; }
+                li:last-child { fill: last; }
+                li:only-child { fill: only; }
+                li:nth-child(2n+3) { stroke: odd; }
+                li:hover { stroke-width: 3; }
+            )qwertyuiop";
+
+            const auto css_dom = read_css(css);
+
+            // pseudo-class specificity is same as class selector specificity
+            for(const auto& s : css_dom.styles){
+                tst::check_eq(s.specificity, uint32_t((1 << 8) | 1), SL);
+            }
+
+            using node = utki::tree<om_node>;
+            node::container_type dom{
+                node(om_node("ul"), {
+                    node(om_node("li")),
+                    node(om_node("li")),
+                    node(om_node("li")),
+                    node(om_node("li")),
+                    node(om_node("li"))
+                }),
+                node(om_node("ul"), {
+                    node(om_node("li"))
+                })
+            };
+
+            // crawler which does not know sibling positions and relies on sibling cache instead
+            class caching_crawler : public cssom::caching_xml_dom_crawler{
+                ::crawler cr;
+            public:
+                caching_crawler(cssom::sibling_cache& cache, const node::container_type& root, std::vector<size_t> index) :
+                        cssom::caching_xml_dom_crawler(cache),
+                        cr(root, std::move(index))
+                {}
+
+                const cssom::styleable& get()override{
+                    return this->cr.get();
+                }
+
+                bool move_up()override{
+                    return this->cr.move_up();
+                }
+
+                bool move_left()override{
+                    return this->cr.move_left();
+                }
+
+                bool move_right()override{
+                    return this->cr.move_right();
+                }
+
+                void reset()override{
+                    this->cr.reset();
+                }
+            };
+
+            cssom::sibling_cache cache;
+
+            auto get_value = [&](std::vector<size_t> index, property_id id, bool use_cache) -> std::string {
+                std::unique_ptr<cssom::xml_dom_crawler> cr;
+                if(use_cache){
+                    cr = std::make_unique<caching_crawler>(cache, dom, std::move(index));
+                }else{
+                    cr = std::make_unique<crawler>(dom, std::move(index));
+                }
+                auto qr = css_dom.get_property_value(*cr, uint32_t(id));
+                if(!qr.value){
+                    return {};
+                }
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+                return static_cast<const property_value*>(qr.value)->value;
+            };
+
+            for(bool use_cache : {false, true}){
+                tst::check_eq(get_value({0, 0}, property_id::fill, use_cache), std::string("first"), SL);
+                tst::check_eq(get_value({0, 1}, property_id::fill, use_cache), std::string(), SL);
+                tst::check_eq(get_value({0, 4}, property_id::fill, use_cache), std::string("last"), SL);
+                tst::check_eq(get_value({1, 0}, property_id::fill, use_cache), std::string("only"), SL);
+
+                tst::check_eq(get_value({0, 0}, property_id::stroke, use_cache), std::string(), SL);
+                tst::check_eq(get_value({0, 1}, property_id::stroke, use_cache), std::string(), SL);
+                tst::check_eq(get_value({0, 2}, property_id::stroke, use_cache), std::string("odd"), SL);
+                tst::check_eq(get_value({0, 3}, property_id::stroke, use_cache), std::string(), SL);
+                tst::check_eq(get_value({0, 4}, property_id::stroke, use_cache), std::string("odd"), SL);
+
+                // unsupported pseudo-classes never match
+                tst::check_eq(get_value({0, 0}, property_id::stroke_width, use_cache), std::string(), SL);
+            }
+
+            // bare node has no sibling position, so selectors with pseudo-classes never match it
+            for(const auto& s : css_dom.styles){
+                tst::check(!s.selectors.back().is_matching(om_node("li")), SL);
+            }
+
+            cssom::selector li;
+            li.tag = "li";
+            tst::check(li.is_matching(om_node("li")), SL);
+
+            // numbers not fitting int make the selector malformed
+            for(auto malformed : {"li:nth-child(99999999999n) { fill: x; }", "li:nth-child(2n+99999999999) { fill: x; }"}){
+                bool thrown = false;
+                try{
+                    read_css(malformed);
+                }catch(const cssom::malformed_css_error&){
+                    thrown = true;
+                }
+                tst::check(thrown, SL) << malformed;
+            }
+
+            // biggest int is fine
+            auto big = read_css("li:nth-child(-2147483647n+2147483647) { fill: big; }");
+            tst::check_eq(big.styles.size(), size_t(1), SL);
+            tst::check(big.styles.front().selectors.front().pseudo_classes.front().is_matching(cssom::sibling_position{0, 1}) == false, SL);
+        }
+    );
+    suite.add(
+        "combinators_need_backtracking",
+        [](){
+            auto css = R"qwertyuiop(
+                a > b c { fill: red; }
+                a + b c { stroke: blue; }
+                a b > c d { stroke-width: 3; }
+            )qwertyuiop";
+
+            const auto css_dom = read_css(css);
+
+            // nearest 'b' ancestor of 'c' is not a child of 'a', nor follows 'a', but farther 'b' ancestor does
+            using node = utki::tree<om_node>;
+            node::container_type dom{
+                node(om_node("a")),
+                node(om_node("b"), {
+                    node(om_node("b"), {
+                        node(om_node("c"), {
+                            node(om_node("e"), {
+                                node(om_node("d"))
+                            })
+                        })
+                    })
+                }),
+                node(om_node("a"), {
+                    node(om_node("b"), {
+                        node(om_node("b"), {
+                            node(om_node("c"))
+                        })
+                    }),
+                    node(om_node("x"), {
+                        node(om_node("c"))
+                    })
+                })
+            };
+
+            auto get_value = [&](std::vector<size_t> index, property_id id) -> std::string {
+                crawler cr(dom, std::move(index));
+                auto qr = css_dom.get_property_value(cr, uint32_t(id));
+                if(!qr.value){
+                    return {};
+                }
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+                return static_cast<const property_value*>(qr.value)->value;
+            };
+
+            tst::check_eq(get_value({2, 0, 0, 0}, property_id::fill), std::string("red"), SL);
+            tst::check_eq(get_value({2, 1, 0}, property_id::fill), std::string(), SL);
+            tst::check_eq(get_value({1, 0, 0}, property_id::fill), std::string(), SL);
+            tst::check_eq(get_value({1, 0, 0}, property_id::stroke), std::string("blue"), SL);
+            tst::check_eq(get_value({2, 0, 0, 0}, property_id::stroke), std::string(), SL);
+            tst::check_eq(get_value({1, 0, 0, 0, 0}, property_id::stroke_width), std::string(), SL);
+        }
+    );
 });
 }